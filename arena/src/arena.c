@@ -8,13 +8,34 @@ struct arena *arena_create(size_t chunk_size, uint32_t chunk_capacity)
         return NULL;
     }
 
-    struct arena *a = malloc(sizeof(struct arena));
+    /* the arena, its chunk table and its chunks all come from the chunk cache,
+       so creating and destroying arenas in a steady state does not touch malloc */
+    struct arena *a = chunk_cache_get(sizeof(struct arena));
+    if (a == NULL)
+    {
+        return NULL;
+    }
+
     a->chunk_size = chunk_size;
     a->chunk_count = 1;
-    a->chunk_capacity = chunk_capacity;
+    /* the chunk table is rounded up to its cache size class anyway, so make use of all of it */
+    a->chunk_capacity = chunk_cache_class_size(sizeof(char *) * chunk_capacity) / sizeof(char *);
     a->offset = 0;
-    a->chunks = malloc(sizeof(char *) * a->chunk_capacity);
-    a->chunks[0] = malloc(sizeof(char) * a->chunk_size);
+    a->chunks = chunk_cache_get(sizeof(char *) * a->chunk_capacity);
+    if (a->chunks == NULL)
+    {
+        chunk_cache_put(a, sizeof(struct arena));
+        return NULL;
+    }
+
+    a->chunks[0] = chunk_cache_get(a->chunk_size);
+    if (a->chunks[0] == NULL)
+    {
+        chunk_cache_put(a->chunks, sizeof(char *) * a->chunk_capacity);
+        chunk_cache_put(a, sizeof(struct arena));
+        return NULL;
+    }
+
     return a;
 }
 
@@ -25,6 +46,13 @@ struct arena *arena_create_default()
 
 void *arena_alloc_align(struct arena *a, size_t size, size_t align)
 {
+    /* allocations can never span chunks */
+    if (size > a->chunk_size)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
     uint32_t current_chunk = a->chunk_count - 1;
     /* align with data type */
     _arena_offset_align(a, align);
@@ -37,10 +65,17 @@ void *arena_alloc_align(struct arena *a, size_t size, size_t align)
         if (current_chunk >= a->chunk_capacity)
         {
             /* extend chunk capacity to make space */
-            _arena_chunk_capacity_extend(a);
+            if (_arena_chunk_capacity_extend(a) != 0)
+            {
+                return NULL;
+            }
         }
 
-        a->chunks[current_chunk] = malloc(sizeof(char) * a->chunk_size);
+        a->chunks[current_chunk] = chunk_cache_get(a->chunk_size);
+        if (a->chunks[current_chunk] == NULL)
+        {
+            return NULL;
+        }
         a->offset = 0;
         a->chunk_count += 1;
     }
@@ -56,24 +91,68 @@ void *arena_alloc(struct arena *a, size_t size)
     return arena_alloc_align(a, size, alignof(max_align_t));
 }
 
+void *arena_realloc(struct arena *a, void *ptr, size_t old_size, size_t new_size)
+{
+    if (ptr == NULL)
+    {
+        return arena_alloc(a, new_size);
+    }
+
+    /* if this is the most recent allocation and the current chunk has room, grow or shrink it in place */
+    char *chunk = a->chunks[a->chunk_count - 1];
+    if ((char *)ptr >= chunk && (char *)ptr + old_size == chunk + a->offset)
+    {
+        size_t start = (char *)ptr - chunk;
+        if (start + new_size <= a->chunk_size)
+        {
+            a->offset = start + new_size;
+            return ptr;
+        }
+    }
+
+    if (new_size <= old_size)
+    {
+        return ptr;
+    }
+
+    void *new = arena_alloc(a, new_size);
+    if (new == NULL)
+    {
+        return NULL;
+    }
+    memcpy(new, ptr, old_size);
+    return new;
+}
+
 void arena_destroy(struct arena *a)
 {
     for (int i = 0; i < a->chunk_count; i++)
     {
-        free(a->chunks[i]);
+        chunk_cache_put(a->chunks[i], a->chunk_size);
     }
-    free(a->chunks);
-    free(a);
+    chunk_cache_put(a->chunks, sizeof(char *) * a->chunk_capacity);
+    chunk_cache_put(a, sizeof(struct arena));
 }
 
 void _arena_offset_align(struct arena *a, size_t align)
 {
-    a->offset += (align - 1) & ~(align + 1);
+    /* align must be a power of two: round offset up to the next multiple of it */
+    a->offset = (a->offset + align - 1) & ~(align - 1);
 }
 
-void _arena_chunk_capacity_extend(struct arena *a)
+int _arena_chunk_capacity_extend(struct arena *a)
 {
     uint32_t new_capacity = a->chunk_capacity * 2;
-    a->chunks = realloc(a->chunks, sizeof(char *) * new_capacity);
+    char **new_chunks = chunk_cache_get(sizeof(char *) * new_capacity);
+    if (new_chunks == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memcpy(new_chunks, a->chunks, sizeof(char *) * a->chunk_count);
+    chunk_cache_put(a->chunks, sizeof(char *) * a->chunk_capacity);
+    a->chunks = new_chunks;
     a->chunk_capacity = new_capacity;
+    return 0;
 }
\ No newline at end of file
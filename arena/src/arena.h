@@ -1,10 +1,17 @@
+#pragma once
+
 #include <stdint.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <stdalign.h>
+#include <string.h>
+#include <errno.h>
 #include <math.h>
 
 #include <stdio.h>
 
+#include "chunk_cache.h"
+
 struct arena
 {
     char **chunks;
@@ -19,8 +26,9 @@ struct arena *arena_create_default();
 
 void *arena_alloc(struct arena *arena, size_t size);
 void *arena_alloc_align(struct arena *arena, size_t size, size_t align);
+void *arena_realloc(struct arena *arena, void *ptr, size_t old_size, size_t new_size);
 
 void arena_destroy(struct arena *arena);
 
-void _arena_chunk_capacity_extend(struct arena *a);
+int _arena_chunk_capacity_extend(struct arena *a);
 void _arena_offset_align(struct arena *a, size_t align);
\ No newline at end of file
@@ -0,0 +1,340 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+
+#include "chunk_cache.h"
+
+/* free chunks are kept in intrusive singly linked lists: the first word of a free chunk points to the next one */
+struct chunk_node
+{
+    struct chunk_node *next;
+};
+
+struct chunk_bucket
+{
+    struct chunk_node *head;
+    uint32_t count;
+};
+
+struct chunk_cache_local
+{
+    struct chunk_bucket buckets[_CHUNK_CACHE_BUCKETS];
+    struct chunk_cache_stats stats;
+    bool registered;
+};
+
+struct chunk_cache_shared
+{
+    pthread_mutex_t lock;
+    struct chunk_bucket buckets[_CHUNK_CACHE_BUCKETS];
+    /* counters of exited threads, plus everything done on the shared cache itself */
+    struct chunk_cache_stats stats;
+    uint64_t last_used_ns;
+};
+
+static struct chunk_cache_config _config = {
+    .local_high = 4 << 20,
+    .local_low = 1 << 20,
+    .shared_high = 16 << 20,
+    .shared_low = 1 << 20,
+    .idle_trim_ns = 1000000000,
+};
+
+static struct chunk_cache_shared _shared = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static thread_local struct chunk_cache_local _local;
+
+static pthread_key_t _exit_key;
+static pthread_once_t _exit_key_once = PTHREAD_ONCE_INIT;
+
+static uint64_t _chunk_cache_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* returns the bucket for `size', or -1 if it is too large to be cached */
+static int _chunk_cache_bucket(size_t size)
+{
+    if (size <= ((size_t)1 << _CHUNK_CACHE_MIN_SHIFT))
+    {
+        return 0;
+    }
+    if (size > ((size_t)1 << _CHUNK_CACHE_MAX_SHIFT))
+    {
+        return -1;
+    }
+
+    int shift = 64 - __builtin_clzll((unsigned long long)(size - 1));
+    return shift - _CHUNK_CACHE_MIN_SHIFT;
+}
+
+static size_t _chunk_cache_bucket_size(int bucket)
+{
+    return (size_t)1 << (bucket + _CHUNK_CACHE_MIN_SHIFT);
+}
+
+/* turns a watermark in bytes into a chunk count for `bucket', rounding 0 up to 1 if `at_least_one' is set */
+static uint32_t _chunk_cache_limit(size_t bytes, int bucket, bool at_least_one)
+{
+    size_t count = bytes >> (bucket + _CHUNK_CACHE_MIN_SHIFT);
+    if (count > _CHUNK_CACHE_MAX_CHUNKS)
+    {
+        count = _CHUNK_CACHE_MAX_CHUNKS;
+    }
+    if (at_least_one && count == 0)
+    {
+        count = 1;
+    }
+    return (uint32_t)count;
+}
+
+static struct chunk_node *_chunk_bucket_pop(struct chunk_bucket *b)
+{
+    struct chunk_node *n = b->head;
+    b->head = n->next;
+    b->count--;
+    return n;
+}
+
+static void _chunk_bucket_push(struct chunk_bucket *b, struct chunk_node *n)
+{
+    n->next = b->head;
+    b->head = n;
+    b->count++;
+}
+
+/* frees chunks from a shared bucket until it holds `keep'. caller holds the shared lock */
+static void _chunk_cache_shared_shrink(int bucket, uint32_t keep)
+{
+    struct chunk_bucket *b = &_shared.buckets[bucket];
+    while (b->count > keep)
+    {
+        free(_chunk_bucket_pop(b));
+        _shared.stats.os_frees++;
+    }
+}
+
+/* moves chunks from the local bucket into the shared cache until the local bucket holds `keep'.
+ * `touch' marks the shared cache as used, which holds off idle trimming */
+static void _chunk_cache_spill(int bucket, uint32_t keep, bool touch)
+{
+    struct chunk_bucket *lb = &_local.buckets[bucket];
+    if (lb->count <= keep)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&_shared.lock);
+    while (lb->count > keep)
+    {
+        _chunk_bucket_push(&_shared.buckets[bucket], _chunk_bucket_pop(lb));
+        _local.stats.spills++;
+    }
+    _chunk_cache_shared_shrink(bucket, _chunk_cache_limit(_config.shared_high, bucket, true));
+    if (touch)
+    {
+        _shared.last_used_ns = _chunk_cache_now_ns();
+    }
+    pthread_mutex_unlock(&_shared.lock);
+}
+
+static void _chunk_cache_thread_exit(void *arg)
+{
+    (void)arg;
+    chunk_cache_flush();
+
+    pthread_mutex_lock(&_shared.lock);
+    _shared.stats.local_hits += _local.stats.local_hits;
+    _shared.stats.shared_hits += _local.stats.shared_hits;
+    _shared.stats.misses += _local.stats.misses;
+    _shared.stats.spills += _local.stats.spills;
+    _shared.stats.os_frees += _local.stats.os_frees;
+    pthread_mutex_unlock(&_shared.lock);
+
+    _local.stats = (struct chunk_cache_stats){0};
+}
+
+static void _chunk_cache_make_exit_key(void)
+{
+    pthread_key_create(&_exit_key, _chunk_cache_thread_exit);
+}
+
+/* make sure the local cache is handed back to the shared cache when this thread exits */
+static void _chunk_cache_register(void)
+{
+    pthread_once(&_exit_key_once, _chunk_cache_make_exit_key);
+    /* any non-NULL value will do, the destructor only runs for non-NULL values */
+    pthread_setspecific(_exit_key, &_local);
+    _local.registered = true;
+}
+
+void *chunk_cache_get(size_t size)
+{
+    int bucket = _chunk_cache_bucket(size);
+    if (bucket < 0)
+    {
+        _local.stats.misses++;
+        void *chunk = malloc(size);
+        if (chunk == NULL)
+        {
+            errno = ENOMEM;
+        }
+        return chunk;
+    }
+
+    struct chunk_bucket *lb = &_local.buckets[bucket];
+    if (lb->head != NULL)
+    {
+        _local.stats.local_hits++;
+        return _chunk_bucket_pop(lb);
+    }
+
+    if (!_local.registered)
+    {
+        _chunk_cache_register();
+    }
+
+    /* refill from the shared cache so the next few requests stay thread-local */
+    pthread_mutex_lock(&_shared.lock);
+    struct chunk_bucket *sb = &_shared.buckets[bucket];
+    if (sb->head != NULL)
+    {
+        uint32_t refill = _chunk_cache_limit(_config.local_low, bucket, true);
+        while (sb->head != NULL && lb->count < refill)
+        {
+            _chunk_bucket_push(lb, _chunk_bucket_pop(sb));
+        }
+        _shared.last_used_ns = _chunk_cache_now_ns();
+    }
+    pthread_mutex_unlock(&_shared.lock);
+
+    if (lb->head != NULL)
+    {
+        _local.stats.shared_hits++;
+        return _chunk_bucket_pop(lb);
+    }
+
+    _local.stats.misses++;
+    void *chunk = malloc(_chunk_cache_bucket_size(bucket));
+    if (chunk == NULL)
+    {
+        errno = ENOMEM;
+    }
+    return chunk;
+}
+
+void chunk_cache_put(void *chunk, size_t size)
+{
+    if (chunk == NULL)
+    {
+        return;
+    }
+
+    int bucket = _chunk_cache_bucket(size);
+    if (bucket < 0)
+    {
+        _local.stats.os_frees++;
+        free(chunk);
+        return;
+    }
+
+    if (!_local.registered)
+    {
+        _chunk_cache_register();
+    }
+
+    struct chunk_bucket *lb = &_local.buckets[bucket];
+    _chunk_bucket_push(lb, chunk);
+    if (lb->count > _chunk_cache_limit(_config.local_high, bucket, true))
+    {
+        _chunk_cache_spill(bucket, _chunk_cache_limit(_config.local_low, bucket, false), true);
+    }
+}
+
+size_t chunk_cache_class_size(size_t size)
+{
+    int bucket = _chunk_cache_bucket(size);
+    return bucket < 0 ? size : _chunk_cache_bucket_size(bucket);
+}
+
+void chunk_cache_configure(const struct chunk_cache_config *config)
+{
+    pthread_mutex_lock(&_shared.lock);
+    _config = *config;
+    if (_config.local_low > _config.local_high)
+    {
+        _config.local_low = _config.local_high;
+    }
+    if (_config.shared_low > _config.shared_high)
+    {
+        _config.shared_low = _config.shared_high;
+    }
+    pthread_mutex_unlock(&_shared.lock);
+}
+
+void chunk_cache_get_config(struct chunk_cache_config *out)
+{
+    pthread_mutex_lock(&_shared.lock);
+    *out = _config;
+    pthread_mutex_unlock(&_shared.lock);
+}
+
+void chunk_cache_trim(void)
+{
+    /* trimming's own spills are not use of the shared cache, or they would always make it look busy */
+    for (int i = 0; i < _CHUNK_CACHE_BUCKETS; i++)
+    {
+        _chunk_cache_spill(i, _chunk_cache_limit(_config.local_low, i, false), false);
+    }
+
+    pthread_mutex_lock(&_shared.lock);
+    if (_chunk_cache_now_ns() - _shared.last_used_ns >= _config.idle_trim_ns)
+    {
+        for (int i = 0; i < _CHUNK_CACHE_BUCKETS; i++)
+        {
+            _chunk_cache_shared_shrink(i, _chunk_cache_limit(_config.shared_low, i, false));
+        }
+    }
+    pthread_mutex_unlock(&_shared.lock);
+}
+
+void chunk_cache_flush(void)
+{
+    for (int i = 0; i < _CHUNK_CACHE_BUCKETS; i++)
+    {
+        _chunk_cache_spill(i, 0, true);
+    }
+}
+
+void chunk_cache_stats(struct chunk_cache_stats *out)
+{
+    size_t local_bytes = 0;
+    for (int i = 0; i < _CHUNK_CACHE_BUCKETS; i++)
+    {
+        local_bytes += (size_t)_local.buckets[i].count * _chunk_cache_bucket_size(i);
+    }
+
+    pthread_mutex_lock(&_shared.lock);
+    *out = _shared.stats;
+    for (int i = 0; i < _CHUNK_CACHE_BUCKETS; i++)
+    {
+        out->cached_bytes += (size_t)_shared.buckets[i].count * _chunk_cache_bucket_size(i);
+    }
+    pthread_mutex_unlock(&_shared.lock);
+
+    out->local_hits += _local.stats.local_hits;
+    out->shared_hits += _local.stats.shared_hits;
+    out->misses += _local.stats.misses;
+    out->spills += _local.stats.spills;
+    out->os_frees += _local.stats.os_frees;
+    out->cached_bytes += local_bytes;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// Smallest cached size class (as a power of two). Requests below this are rounded up.
+#define _CHUNK_CACHE_MIN_SHIFT 4
+/// Largest cached size class (as a power of two). Requests above this bypass the cache entirely.
+#define _CHUNK_CACHE_MAX_SHIFT 24
+/// Number of size classes (buckets) in each cache.
+#define _CHUNK_CACHE_BUCKETS (_CHUNK_CACHE_MAX_SHIFT - _CHUNK_CACHE_MIN_SHIFT + 1)
+
+/// Most free chunks a single size class keeps in one cache, however small its chunks are.
+#define _CHUNK_CACHE_MAX_CHUNKS 4096
+
+/// Watermarks controlling how much free memory is kept around, in bytes per size class.
+/// Each watermark becomes a chunk count by dividing it by the class size (capped at `_CHUNK_CACHE_MAX_CHUNKS'),
+/// so large classes keep few chunks. A high watermark always allows at least one chunk.
+/// The thread-local cache spills down to `local_low' into the shared cache once it holds more than `local_high',
+/// and refills up to `local_low' (at least one chunk) from the shared cache when it runs dry.
+/// The shared cache frees chunks back to the OS once it holds more than `shared_high',
+/// and `chunk_cache_trim' frees it down to `shared_low' once it has been idle for `idle_trim_ns'.
+struct chunk_cache_config
+{
+    size_t local_high;
+    size_t local_low;
+    size_t shared_high;
+    size_t shared_low;
+    uint64_t idle_trim_ns;
+};
+
+/// Counters describing cache behaviour. `chunk_cache_stats' reports the shared totals
+/// (including those of exited threads) plus the calling thread's own counters.
+struct chunk_cache_stats
+{
+    /// Requests served from the calling thread's local cache.
+    uint64_t local_hits;
+    /// Requests served by refilling from the shared cache.
+    uint64_t shared_hits;
+    /// Requests that had to call malloc.
+    uint64_t misses;
+    /// Chunks moved from a local cache into the shared cache.
+    uint64_t spills;
+    /// Chunks handed back to the OS with free.
+    uint64_t os_frees;
+    /// Bytes currently held in the shared cache and the calling thread's local cache.
+    size_t cached_bytes;
+};
+
+/// Get a chunk of at least `size' bytes, aligned for any type. Returns NULL and sets errno if no memory is available.
+/// The chunk must be returned with `chunk_cache_put' using the same `size'.
+void *chunk_cache_get(size_t size);
+/// Return a chunk previously obtained from `chunk_cache_get' with the same `size'. NULL is ignored.
+void chunk_cache_put(void *chunk, size_t size);
+
+/// Get the real size of the chunk that `chunk_cache_get' hands out for a request of `size' bytes.
+size_t chunk_cache_class_size(size_t size);
+
+/// Replace the cache watermarks. This should be called before other threads start using the cache.
+void chunk_cache_configure(const struct chunk_cache_config *config);
+/// Get the current cache watermarks.
+void chunk_cache_get_config(struct chunk_cache_config *out);
+
+/// Move the calling thread's free chunks above `local_low' into the shared cache, and if the shared cache
+/// has not been used for `idle_trim_ns', free it down to `shared_low'. Intended to be called between requests or from a timer.
+void chunk_cache_trim(void);
+/// Move all of the calling thread's free chunks into the shared cache. This happens automatically when a thread exits.
+void chunk_cache_flush(void);
+
+/// Fill `out' with the current cache counters.
+void chunk_cache_stats(struct chunk_cache_stats *out);
@@ -0,0 +1,192 @@
+#include "intern.h"
+
+/* FNV-1a: simple and good enough for short names */
+static uint64_t _intern_hash(const char *s, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+/* returns the slot holding `s', or the empty slot where it belongs */
+static struct intern_slot *_intern_probe(struct intern_slot *slots, uint32_t capacity, const char *s, size_t len, uint64_t hash)
+{
+    uint32_t mask = capacity - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        struct intern_slot *slot = &slots[i];
+        if (slot->str == NULL)
+        {
+            return slot;
+        }
+        if (slot->hash == hash && slot->len == len && memcmp(slot->str, s, len) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+static int _intern_grow_slots(struct intern_table *t)
+{
+    uint32_t new_capacity = t->slot_capacity * 2;
+    struct intern_slot *new_slots = chunk_cache_get(sizeof(struct intern_slot) * new_capacity);
+    if (new_slots == NULL)
+    {
+        return -1;
+    }
+    memset(new_slots, 0, sizeof(struct intern_slot) * new_capacity);
+
+    for (uint32_t i = 0; i < t->slot_capacity; i++)
+    {
+        struct intern_slot *old = &t->slots[i];
+        if (old->str != NULL)
+        {
+            *_intern_probe(new_slots, new_capacity, old->str, old->len, old->hash) = *old;
+        }
+    }
+
+    chunk_cache_put(t->slots, sizeof(struct intern_slot) * t->slot_capacity);
+    t->slots = new_slots;
+    t->slot_capacity = new_capacity;
+    return 0;
+}
+
+static int _intern_grow_strings(struct intern_table *t)
+{
+    uint32_t new_capacity = t->strings_capacity * 2;
+    const char **new_strings = chunk_cache_get(sizeof(char *) * new_capacity);
+    if (new_strings == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(new_strings, t->strings, sizeof(char *) * t->len);
+    chunk_cache_put(t->strings, sizeof(char *) * t->strings_capacity);
+    t->strings = new_strings;
+    t->strings_capacity = new_capacity;
+    return 0;
+}
+
+struct intern_table *intern_table_create(struct arena *arena)
+{
+    struct intern_table *t = arena_alloc(arena, sizeof(struct intern_table));
+    if (t == NULL)
+    {
+        return NULL;
+    }
+
+    t->arena = arena;
+    t->len = 0;
+    t->slot_capacity = _INTERN_SLOTS_DEFAULT;
+    t->slots = chunk_cache_get(sizeof(struct intern_slot) * t->slot_capacity);
+    if (t->slots == NULL)
+    {
+        return NULL;
+    }
+    memset(t->slots, 0, sizeof(struct intern_slot) * t->slot_capacity);
+
+    t->strings_capacity = _INTERN_SLOTS_DEFAULT / 2;
+    t->strings = chunk_cache_get(sizeof(char *) * t->strings_capacity);
+    if (t->strings == NULL)
+    {
+        chunk_cache_put(t->slots, sizeof(struct intern_slot) * t->slot_capacity);
+        return NULL;
+    }
+
+    return t;
+}
+
+static struct intern_slot *_intern_insert(struct intern_table *t, const char *s, size_t len)
+{
+    if (len >= UINT32_MAX)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uint64_t hash = _intern_hash(s, len);
+    struct intern_slot *slot = _intern_probe(t->slots, t->slot_capacity, s, len, hash);
+    if (slot->str != NULL)
+    {
+        return slot;
+    }
+
+    /* keep the load factor at or below 1/2 so probe sequences stay short */
+    if ((t->len + 1) * 2 > t->slot_capacity)
+    {
+        if (_intern_grow_slots(t) != 0)
+        {
+            return NULL;
+        }
+        slot = _intern_probe(t->slots, t->slot_capacity, s, len, hash);
+    }
+    if (t->len >= t->strings_capacity && _intern_grow_strings(t) != 0)
+    {
+        return NULL;
+    }
+
+    char *copy = arena_alloc_align(t->arena, len + 1, 1);
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+
+    slot->str = copy;
+    slot->hash = hash;
+    slot->len = len;
+    slot->id = t->len;
+    t->strings[t->len] = copy;
+    t->len++;
+    return slot;
+}
+
+const char *intern(struct intern_table *t, const char *s, size_t len)
+{
+    struct intern_slot *slot = _intern_insert(t, s, len);
+    return slot == NULL ? NULL : slot->str;
+}
+
+const char *intern_cstr(struct intern_table *t, const char *s)
+{
+    return intern(t, s, strlen(s));
+}
+
+uint32_t intern_id(struct intern_table *t, const char *s, size_t len)
+{
+    struct intern_slot *slot = _intern_insert(t, s, len);
+    return slot == NULL ? _INTERN_ID_NONE : slot->id;
+}
+
+const char *intern_lookup(struct intern_table *t, const char *s, size_t len)
+{
+    struct intern_slot *slot = _intern_probe(t->slots, t->slot_capacity, s, len, _intern_hash(s, len));
+    return slot->str;
+}
+
+const char *intern_str(struct intern_table *t, uint32_t id)
+{
+    if (id >= t->len)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    return t->strings[id];
+}
+
+uint32_t intern_len(struct intern_table *t)
+{
+    return t->len;
+}
+
+void intern_table_destroy(struct intern_table *t)
+{
+    chunk_cache_put(t->slots, sizeof(struct intern_slot) * t->slot_capacity);
+    chunk_cache_put(t->strings, sizeof(char *) * t->strings_capacity);
+    /* the table struct itself lives in the arena */
+}
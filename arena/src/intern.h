@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+/// Returned by `intern_id' when a string could not be interned.
+#define _INTERN_ID_NONE UINT32_MAX
+/// Initial number of hash slots in an intern table.
+#define _INTERN_SLOTS_DEFAULT 64
+
+struct intern_slot
+{
+    const char *str;
+    uint64_t hash;
+    uint32_t len;
+    uint32_t id;
+};
+
+/// An intern table stores a single copy of each distinct string in an arena.
+/// Interning equal strings returns the same pointer and id, so interned strings can be compared by pointer (or id) instead of with strcmp.
+/// Interned strings are NUL-terminated and stay valid until the arena is destroyed, even after the table itself is destroyed.
+struct intern_table
+{
+    struct arena *arena;
+    /// Open-addressed hash index. Its capacity is always a power of two.
+    struct intern_slot *slots;
+    uint32_t slot_capacity;
+    /// Interned strings by id.
+    const char **strings;
+    uint32_t strings_capacity;
+    uint32_t len;
+};
+
+/// Create an empty intern table storing its strings in `arena'. Returns NULL and sets errno on failure.
+/// To free this table, call intern_table_destroy.
+struct intern_table *intern_table_create(struct arena *arena);
+
+/// Intern `len' bytes of `s' and return the stable copy, or NULL on failure.
+const char *intern(struct intern_table *t, const char *s, size_t len);
+/// Intern a NUL-terminated string and return the stable copy, or NULL on failure.
+const char *intern_cstr(struct intern_table *t, const char *s);
+/// Intern `len' bytes of `s' and return its id, or _INTERN_ID_NONE on failure. Ids are assigned densely from 0.
+uint32_t intern_id(struct intern_table *t, const char *s, size_t len);
+
+/// Find an already-interned string without inserting it. Returns NULL if it was never interned.
+const char *intern_lookup(struct intern_table *t, const char *s, size_t len);
+/// Get the interned string with the given id, or NULL if there is no such id.
+const char *intern_str(struct intern_table *t, uint32_t id);
+
+/// Get the amount of distinct strings in this table.
+uint32_t intern_len(struct intern_table *t);
+
+/// Destroy this table's index. Interned strings stay valid until the arena is destroyed.
+void intern_table_destroy(struct intern_table *t);
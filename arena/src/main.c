@@ -1,9 +1,38 @@
 #include <stdio.h>
 
 #include "arena.h"
+#include "intern.h"
+#include "strbuf.h"
+
+void strings_demo()
+{
+    struct arena *a = arena_create_default();
+    struct intern_table *names = intern_table_create(a);
+
+    /* equal names intern to the same pointer, so they can be compared without strcmp */
+    const char *alice = intern_cstr(names, "alice");
+    const char *bob = intern_cstr(names, "bob");
+    const char *alice2 = intern(names, "alice smith", 5);
+    printf("alice == alice2? %s, alice == bob? %s, %u distinct names\n",
+           alice == alice2 ? "yes" : "no", alice == bob ? "yes" : "no", intern_len(names));
+
+    /* the builder is the arena's latest allocation, so these appends grow it in place */
+    struct strbuf sb;
+    strbuf_init(&sb, a, 8);
+    for (uint32_t id = 0; id < intern_len(names); id++)
+    {
+        strbuf_appendf(&sb, "%s#%u ", intern_str(names, id), id);
+    }
+    printf("built: \"%s\" (len %zu, capacity %zu)\n", strbuf_cstr(&sb), sb.len, sb.capacity);
+
+    intern_table_destroy(names);
+    arena_destroy(a);
+}
 
 int main()
 {
+    strings_demo();
+
     for (int i = 0; i < 100000000; i++)
     {
         /* init */
@@ -17,4 +46,10 @@ int main()
 
         arena_destroy(a);
     }
+
+    /* after the first iteration everything above is served from the thread-local chunk cache */
+    struct chunk_cache_stats stats;
+    chunk_cache_stats(&stats);
+    printf("chunk cache: %lu local hits, %lu shared hits, %lu mallocs, %lu spills, %lu frees, %zuB cached\n",
+           stats.local_hits, stats.shared_hits, stats.misses, stats.spills, stats.os_frees, stats.cached_bytes);
 }
\ No newline at end of file
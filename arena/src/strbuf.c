@@ -0,0 +1,127 @@
+#include <stdio.h>
+
+#include "strbuf.h"
+
+int strbuf_init(struct strbuf *sb, struct arena *arena, size_t capacity)
+{
+    /* one extra byte for the NUL terminator */
+    sb->data = arena_alloc_align(arena, capacity + 1, 1);
+    if (sb->data == NULL)
+    {
+        return -1;
+    }
+
+    sb->arena = arena;
+    sb->len = 0;
+    sb->capacity = capacity;
+    sb->data[0] = '\0';
+    return 0;
+}
+
+int strbuf_reserve(struct strbuf *sb, size_t additional)
+{
+    size_t needed = sb->len + additional;
+    if (needed <= sb->capacity)
+    {
+        return 0;
+    }
+
+    /* double to keep appends amortised O(1), but never beyond what a chunk can hold */
+    size_t new_capacity = sb->capacity * 2;
+    if (new_capacity < needed)
+    {
+        new_capacity = needed;
+    }
+    if (new_capacity + 1 > sb->arena->chunk_size)
+    {
+        new_capacity = sb->arena->chunk_size - 1;
+    }
+    if (new_capacity < needed)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char *new = arena_realloc(sb->arena, sb->data, sb->capacity + 1, new_capacity + 1);
+    if (new == NULL)
+    {
+        return -1;
+    }
+
+    sb->data = new;
+    sb->capacity = new_capacity;
+    return 0;
+}
+
+int strbuf_append(struct strbuf *sb, const char *s, size_t len)
+{
+    if (strbuf_reserve(sb, len) != 0)
+    {
+        return -1;
+    }
+
+    memcpy(sb->data + sb->len, s, len);
+    sb->len += len;
+    sb->data[sb->len] = '\0';
+    return 0;
+}
+
+int strbuf_append_cstr(struct strbuf *sb, const char *s)
+{
+    return strbuf_append(sb, s, strlen(s));
+}
+
+int strbuf_append_char(struct strbuf *sb, char c)
+{
+    return strbuf_append(sb, &c, 1);
+}
+
+int strbuf_appendf(struct strbuf *sb, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int ret = strbuf_vappendf(sb, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+int strbuf_vappendf(struct strbuf *sb, const char *fmt, va_list args)
+{
+    /* format straight into the spare capacity first: usually it fits and no second pass is needed */
+    va_list retry;
+    va_copy(retry, args);
+    size_t spare = sb->capacity - sb->len;
+    int n = vsnprintf(sb->data + sb->len, spare + 1, fmt, args);
+    if (n < 0)
+    {
+        va_end(retry);
+        return -1;
+    }
+
+    if ((size_t)n > spare)
+    {
+        if (strbuf_reserve(sb, n) != 0)
+        {
+            /* the truncated output must not stay visible */
+            sb->data[sb->len] = '\0';
+            va_end(retry);
+            return -1;
+        }
+        vsnprintf(sb->data + sb->len, n + 1, fmt, retry);
+    }
+
+    va_end(retry);
+    sb->len += n;
+    return 0;
+}
+
+const char *strbuf_cstr(struct strbuf *sb)
+{
+    return sb->data;
+}
+
+void strbuf_reset(struct strbuf *sb)
+{
+    sb->len = 0;
+    sb->data[0] = '\0';
+}
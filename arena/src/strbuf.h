@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+/// A growable string whose buffer lives in an arena.
+/// While the buffer is the arena's most recent allocation it grows in place, otherwise growing copies it to a new arena allocation.
+/// The contents are always NUL-terminated. A string can be at most `chunk_size - 1' bytes long.
+struct strbuf
+{
+    struct arena *arena;
+    char *data;
+    size_t len;
+    /// Usable capacity, not counting the NUL terminator.
+    size_t capacity;
+};
+
+/// Initialise an empty string builder in `arena' with room for `capacity' bytes. Returns 0, or -1 and sets errno on failure.
+int strbuf_init(struct strbuf *sb, struct arena *arena, size_t capacity);
+
+/// Make sure at least `additional' more bytes can be appended without growing. Returns 0, or -1 and sets errno on failure.
+int strbuf_reserve(struct strbuf *sb, size_t additional);
+
+/// Append `len' bytes from `s'. Returns 0, or -1 and sets errno on failure.
+int strbuf_append(struct strbuf *sb, const char *s, size_t len);
+/// Append a NUL-terminated string. Returns 0, or -1 and sets errno on failure.
+int strbuf_append_cstr(struct strbuf *sb, const char *s);
+/// Append a single character. Returns 0, or -1 and sets errno on failure.
+int strbuf_append_char(struct strbuf *sb, char c);
+/// Append printf-style formatted output. Returns 0, or -1 and sets errno on failure.
+int strbuf_appendf(struct strbuf *sb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+/// `va_list' version of `strbuf_appendf'.
+int strbuf_vappendf(struct strbuf *sb, const char *fmt, va_list args);
+
+/// Get the NUL-terminated contents. The pointer is owned by the arena and is invalidated if the builder grows.
+const char *strbuf_cstr(struct strbuf *sb);
+
+/// Clear the contents, keeping the buffer for reuse.
+void strbuf_reset(struct strbuf *sb);
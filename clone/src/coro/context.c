@@ -0,0 +1,156 @@
+#include <stdint.h>
+
+#include "context.h"
+
+/* the switch saves the callee-saved registers on the current stack, stores the stack pointer in `from',
+   loads it from `to' and restores that stack's registers. a new context starts out with a fake saved frame
+   whose return address is `_coro_trampoline', which calls the entry function with its argument */
+
+#if defined(__x86_64__)
+
+__asm__(".pushsection .text\n"
+        ".globl coro_context_switch\n"
+        ".type coro_context_switch, @function\n"
+        "coro_context_switch:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        /* the SSE and x87 control words are callee-saved too */
+        "    subq $8, %rsp\n"
+        "    stmxcsr (%rsp)\n"
+        "    fnstcw 4(%rsp)\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq (%rsi), %rsp\n"
+        "    ldmxcsr (%rsp)\n"
+        "    fldcw 4(%rsp)\n"
+        "    addq $8, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size coro_context_switch, .-coro_context_switch\n"
+        "\n"
+        ".hidden _coro_trampoline\n"
+        ".globl _coro_trampoline\n"
+        ".type _coro_trampoline, @function\n"
+        "_coro_trampoline:\n"
+        "    movq %rbx, %rdi\n"
+        "    callq *%r12\n"
+        "    ud2\n"
+        ".size _coro_trampoline, .-_coro_trampoline\n"
+        ".popsection\n");
+
+/* saved frame, from the stack pointer upwards */
+enum
+{
+    _CTX_CONTROL_WORDS,
+    _CTX_R15,
+    _CTX_R14,
+    _CTX_R13,
+    _CTX_R12,
+    _CTX_RBX,
+    _CTX_RBP,
+    _CTX_RET,
+    _CTX_FRAME_WORDS,
+};
+
+#elif defined(__aarch64__)
+
+__asm__(".pushsection .text\n"
+        ".globl coro_context_switch\n"
+        ".type coro_context_switch, %function\n"
+        "coro_context_switch:\n"
+        "    sub sp, sp, #160\n"
+        "    stp x19, x20, [sp, #0]\n"
+        "    stp x21, x22, [sp, #16]\n"
+        "    stp x23, x24, [sp, #32]\n"
+        "    stp x25, x26, [sp, #48]\n"
+        "    stp x27, x28, [sp, #64]\n"
+        "    stp x29, x30, [sp, #80]\n"
+        "    stp d8, d9, [sp, #96]\n"
+        "    stp d10, d11, [sp, #112]\n"
+        "    stp d12, d13, [sp, #128]\n"
+        "    stp d14, d15, [sp, #144]\n"
+        "    mov x9, sp\n"
+        "    str x9, [x0]\n"
+        "    ldr x9, [x1]\n"
+        "    mov sp, x9\n"
+        "    ldp x19, x20, [sp, #0]\n"
+        "    ldp x21, x22, [sp, #16]\n"
+        "    ldp x23, x24, [sp, #32]\n"
+        "    ldp x25, x26, [sp, #48]\n"
+        "    ldp x27, x28, [sp, #64]\n"
+        "    ldp x29, x30, [sp, #80]\n"
+        "    ldp d8, d9, [sp, #96]\n"
+        "    ldp d10, d11, [sp, #112]\n"
+        "    ldp d12, d13, [sp, #128]\n"
+        "    ldp d14, d15, [sp, #144]\n"
+        "    add sp, sp, #160\n"
+        "    ret\n"
+        ".size coro_context_switch, .-coro_context_switch\n"
+        "\n"
+        ".hidden _coro_trampoline\n"
+        ".globl _coro_trampoline\n"
+        ".type _coro_trampoline, %function\n"
+        "_coro_trampoline:\n"
+        "    mov x0, x19\n"
+        "    blr x20\n"
+        "    brk #0\n"
+        ".size _coro_trampoline, .-_coro_trampoline\n"
+        ".popsection\n");
+
+/* saved frame, from the stack pointer upwards (only the slots a new context needs) */
+enum
+{
+    _CTX_X19 = 0,
+    _CTX_X20 = 1,
+    _CTX_X29 = 10,
+    _CTX_X30 = 11,
+    _CTX_FRAME_WORDS = 20,
+};
+
+#else
+#error "coro_context_switch is only implemented for x86-64 and aarch64"
+#endif
+
+extern void _coro_trampoline(void);
+
+void coro_context_init(struct coro_context *ctx, void *stack_top, void (*entry)(void *), void *arg)
+{
+    uintptr_t top = (uintptr_t)stack_top & ~(uintptr_t)15;
+
+#if defined(__x86_64__)
+    /* leave 16 bytes above the frame so that once the trampoline has been "returned" into,
+       the stack is 16-byte aligned right before it calls `entry', as the ABI requires */
+    uintptr_t *frame = (uintptr_t *)(top - 16) - _CTX_FRAME_WORDS;
+    for (int i = 0; i < _CTX_FRAME_WORDS; i++)
+    {
+        frame[i] = 0;
+    }
+
+    /* start from the default MXCSR (all exceptions masked) and x87 control word (extended precision, all masked) */
+    frame[_CTX_CONTROL_WORDS] = 0x1f80 | ((uintptr_t)0x037f << 32);
+    frame[_CTX_R12] = (uintptr_t)entry;
+    frame[_CTX_RBX] = (uintptr_t)arg;
+    frame[_CTX_RET] = (uintptr_t)_coro_trampoline;
+#elif defined(__aarch64__)
+    uintptr_t *frame = (uintptr_t *)top - _CTX_FRAME_WORDS;
+    for (int i = 0; i < _CTX_FRAME_WORDS; i++)
+    {
+        frame[i] = 0;
+    }
+
+    frame[_CTX_X19] = (uintptr_t)arg;
+    frame[_CTX_X20] = (uintptr_t)entry;
+    frame[_CTX_X29] = 0;
+    frame[_CTX_X30] = (uintptr_t)_coro_trampoline;
+#endif
+
+    ctx->sp = frame;
+}
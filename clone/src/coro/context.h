@@ -0,0 +1,15 @@
+#pragma once
+
+/// A suspended execution context: everything else (callee-saved registers, return address) lives on its own stack.
+struct coro_context
+{
+    void *sp;
+};
+
+/// Prepare `ctx' so that switching to it calls `entry(arg)' on the stack ending at `stack_top'.
+/// `entry' must never return; it has to switch away for the last time instead.
+void coro_context_init(struct coro_context *ctx, void *stack_top, void (*entry)(void *), void *arg);
+
+/// Save the current context into `from' and continue in `to'. Returns when something switches back to `from'.
+/// Only the callee-saved registers are saved, so this costs about as much as a function call.
+void coro_context_switch(struct coro_context *from, struct coro_context *to);
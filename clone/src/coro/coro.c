@@ -0,0 +1,450 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../thread/futex.h"
+#include "coro.h"
+
+static void _coro_main(void *arg)
+{
+    struct coro *co = arg;
+    co->fn(co, co->arg);
+    co->state = CORO_DONE;
+    coro_context_switch(&co->ctx, co->caller);
+    /* a finished coroutine is never resumed again */
+    __builtin_trap();
+}
+
+struct coro *coro_create(struct coro_stack_pool *pool, coro_fn fn, void *arg)
+{
+    char *stack = coro_stack_get(pool);
+    if (stack == NULL)
+    {
+        return NULL;
+    }
+
+    /* the coroutine lives at the very top of its stack, and its first frame starts right below it */
+    uintptr_t top = (uintptr_t)(stack + pool->stack_size);
+    struct coro *co = (struct coro *)((top - sizeof(struct coro)) & ~(uintptr_t)63);
+    memset(co, 0, sizeof(*co));
+    co->fn = fn;
+    co->arg = arg;
+    co->pool = pool;
+    co->stack = stack;
+    co->state = CORO_READY;
+    coro_context_init(&co->ctx, co, _coro_main, co);
+    return co;
+}
+
+int coro_resume(struct coro *co)
+{
+    struct coro_context caller;
+    co->caller = &caller;
+    co->state = CORO_RUNNING;
+    coro_context_switch(&caller, &co->ctx);
+
+    /* without a guard region this is the only place an overflow gets noticed: stop before the damage spreads */
+    if (!coro_stack_intact(co->stack))
+    {
+        __builtin_trap();
+    }
+    return co->state != CORO_DONE;
+}
+
+void coro_yield(struct coro *self)
+{
+    self->state = CORO_READY;
+    coro_context_switch(&self->ctx, self->caller);
+}
+
+void coro_destroy(struct coro *co)
+{
+    coro_stack_put(co->pool, co->stack);
+}
+
+/* switch out as blocked. the scheduler releases `lock' once we are off our stack, so whoever wakes us
+   (which needs `lock') cannot get us running on another worker while we are still switching out here */
+static void _coro_block(struct coro *self, spinlock_t *lock)
+{
+    self->state = CORO_BLOCKED;
+    self->unlock_after_switch = lock;
+    coro_context_switch(&self->ctx, self->caller);
+}
+
+static void _coro_rq_push(struct coro_runtime *rt, struct coro *co)
+{
+    co->next = NULL;
+    spin_lock(&rt->rq_lock);
+    if (rt->rq_tail == NULL)
+    {
+        rt->rq_head = co;
+    }
+    else
+    {
+        rt->rq_tail->next = co;
+    }
+    rt->rq_tail = co;
+    spin_unlock(&rt->rq_lock);
+}
+
+static struct coro *_coro_rq_pop(struct coro_runtime *rt)
+{
+    /* cheap unlocked peek so idle workers do not hammer the lock */
+    if (__atomic_load_n(&rt->rq_head, __ATOMIC_RELAXED) == NULL)
+    {
+        return NULL;
+    }
+
+    spin_lock(&rt->rq_lock);
+    struct coro *co = rt->rq_head;
+    if (co != NULL)
+    {
+        rt->rq_head = co->next;
+        if (rt->rq_head == NULL)
+        {
+            rt->rq_tail = NULL;
+        }
+    }
+    spin_unlock(&rt->rq_lock);
+    return co;
+}
+
+static void _coro_make_ready(struct coro_runtime *rt, struct coro *co)
+{
+    co->state = CORO_READY;
+    _coro_rq_push(rt, co);
+
+    /* pairs with the fence in `_coro_park': either the sleeper sees the queued coroutine, or we see the sleeper */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&rt->sleepers, memory_order_relaxed) > 0)
+    {
+        atomic_fetch_add_explicit(&rt->wake_seq, 1, memory_order_relaxed);
+        futex_wake(&rt->wake_seq, 1);
+    }
+}
+
+static void _coro_park(struct coro_runtime *rt)
+{
+    uint32_t seq = atomic_load_explicit(&rt->wake_seq, memory_order_relaxed);
+    atomic_fetch_add_explicit(&rt->sleepers, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (__atomic_load_n(&rt->rq_head, __ATOMIC_RELAXED) == NULL && !atomic_load_explicit(&rt->shutdown, memory_order_relaxed))
+    {
+        futex_wait(&rt->wake_seq, seq);
+    }
+
+    atomic_fetch_sub_explicit(&rt->sleepers, 1, memory_order_relaxed);
+}
+
+static int _coro_worker_main(void *arg)
+{
+    struct coro_worker *w = arg;
+    struct coro_runtime *rt = w->rt;
+    uint32_t idle_rounds = 0;
+
+    while (!atomic_load_explicit(&rt->shutdown, memory_order_acquire))
+    {
+        struct coro *co = _coro_rq_pop(rt);
+        if (co == NULL)
+        {
+            if (++idle_rounds < _CORO_SPIN_ROUNDS)
+            {
+                cpu_relax();
+            }
+            else
+            {
+                _coro_park(rt);
+                idle_rounds = 0;
+            }
+            continue;
+        }
+        idle_rounds = 0;
+
+        coro_resume(co);
+        switch (co->state)
+        {
+        case CORO_READY:
+            /* yielded: go to the back of the queue */
+            _coro_rq_push(rt, co);
+            break;
+        case CORO_BLOCKED:
+            /* the coroutine may be woken and resumed elsewhere as soon as this is released, so do not touch it after */
+            spin_unlock(co->unlock_after_switch);
+            break;
+        case CORO_DONE:
+            coro_destroy(co);
+            if (atomic_fetch_sub_explicit(&rt->live, 1, memory_order_release) == 1)
+            {
+                futex_wake(&rt->live, INT32_MAX);
+            }
+            break;
+        case CORO_RUNNING:
+            __builtin_trap();
+        }
+    }
+
+    return 0;
+}
+
+struct coro_runtime *coro_runtime_create(const struct coro_runtime_attr *attr)
+{
+    struct coro_runtime_attr a = {0};
+    if (attr != NULL)
+    {
+        a = *attr;
+    }
+    if (a.worker_count == 0)
+    {
+        a.worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (a.stack_size == 0)
+    {
+        a.stack_size = _CORO_STACK_SIZE_DEFAULT;
+    }
+    if (a.guard_size == 0)
+    {
+        a.guard_size = _CORO_GUARD_SIZE_DEFAULT;
+    }
+    else if (a.guard_size == _CORO_NO_GUARD)
+    {
+        a.guard_size = 0;
+    }
+    if (a.max_coroutines == 0)
+    {
+        a.max_coroutines = _CORO_MAX_DEFAULT;
+    }
+
+    struct coro_runtime *rt = aligned_alloc(alignof(struct coro_runtime), sizeof(struct coro_runtime));
+    if (rt == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(rt, 0, sizeof(*rt));
+    rt->rq_lock = (spinlock_t)SPINLOCK_INIT;
+
+    if (coro_stack_pool_init(&rt->stacks, a.stack_size, a.guard_size, a.max_coroutines) != 0)
+    {
+        free(rt);
+        return NULL;
+    }
+
+    rt->workers = calloc(a.worker_count, sizeof(struct coro_worker));
+    if (rt->workers == NULL)
+    {
+        errno = ENOMEM;
+        free(rt);
+        return NULL;
+    }
+
+    struct thread_attr thread_attr = {
+        .stack_size = _CORO_WORKER_STACK_SIZE,
+        .guard_size = _THREAD_GUARD_SIZE_DEFAULT,
+    };
+    for (uint32_t i = 0; i < a.worker_count; i++)
+    {
+        struct coro_worker *w = &rt->workers[i];
+        w->rt = rt;
+        w->id = i;
+        if (thread_spawn(&w->thread, _coro_worker_main, w, &thread_attr) != 0)
+        {
+            int err = errno;
+            w->thread.map = NULL;
+            rt->worker_count = i;
+            coro_runtime_destroy(rt);
+            errno = err;
+            return NULL;
+        }
+    }
+    rt->worker_count = a.worker_count;
+
+    return rt;
+}
+
+struct coro *coro_spawn(struct coro_runtime *rt, coro_fn fn, void *arg)
+{
+    struct coro *co = coro_create(&rt->stacks, fn, arg);
+    if (co == NULL)
+    {
+        return NULL;
+    }
+
+    co->rt = rt;
+    atomic_fetch_add_explicit(&rt->live, 1, memory_order_relaxed);
+    _coro_make_ready(rt, co);
+    return co;
+}
+
+void coro_runtime_wait(struct coro_runtime *rt)
+{
+    uint32_t live;
+    while ((live = atomic_load_explicit(&rt->live, memory_order_acquire)) != 0)
+    {
+        futex_wait(&rt->live, live);
+    }
+}
+
+void coro_runtime_destroy(struct coro_runtime *rt)
+{
+    atomic_store_explicit(&rt->shutdown, 1, memory_order_release);
+    atomic_fetch_add_explicit(&rt->wake_seq, 1, memory_order_seq_cst);
+    futex_wake(&rt->wake_seq, INT32_MAX);
+
+    for (uint32_t i = 0; i < rt->worker_count; i++)
+    {
+        thread_join(&rt->workers[i].thread);
+    }
+
+    coro_stack_pool_destroy(&rt->stacks);
+    free(rt->workers);
+    free(rt);
+}
+
+static void _coro_waiter_push(struct coro **head, struct coro **tail, struct coro *co)
+{
+    co->next = NULL;
+    if (*tail == NULL)
+    {
+        *head = co;
+    }
+    else
+    {
+        (*tail)->next = co;
+    }
+    *tail = co;
+}
+
+static struct coro *_coro_waiter_pop(struct coro **head, struct coro **tail)
+{
+    struct coro *co = *head;
+    if (co != NULL)
+    {
+        *head = co->next;
+        if (*head == NULL)
+        {
+            *tail = NULL;
+        }
+    }
+    return co;
+}
+
+void coro_channel_init(struct coro_channel *ch, void **buffer, uint32_t capacity)
+{
+    memset(ch, 0, sizeof(*ch));
+    ch->lock = (spinlock_t)SPINLOCK_INIT;
+    ch->buffer = buffer;
+    ch->capacity = capacity;
+}
+
+int coro_channel_send(struct coro *self, struct coro_channel *ch, void *value)
+{
+    spin_lock(&ch->lock);
+    if (ch->closed)
+    {
+        spin_unlock(&ch->lock);
+        return -1;
+    }
+
+    /* a waiting receiver means the buffer is empty: hand the value over directly */
+    struct coro *receiver = _coro_waiter_pop(&ch->recv_head, &ch->recv_tail);
+    if (receiver != NULL)
+    {
+        spin_unlock(&ch->lock);
+        receiver->transfer = value;
+        receiver->transfer_status = 0;
+        _coro_make_ready(receiver->rt, receiver);
+        return 0;
+    }
+
+    if (ch->len < ch->capacity)
+    {
+        ch->buffer[(ch->head + ch->len) % ch->capacity] = value;
+        ch->len++;
+        spin_unlock(&ch->lock);
+        return 0;
+    }
+
+    self->transfer = value;
+    _coro_waiter_push(&ch->send_head, &ch->send_tail, self);
+    _coro_block(self, &ch->lock);
+    return self->transfer_status;
+}
+
+int coro_channel_recv(struct coro *self, struct coro_channel *ch, void **out)
+{
+    spin_lock(&ch->lock);
+    struct coro *sender;
+    if (ch->len > 0)
+    {
+        *out = ch->buffer[ch->head];
+        ch->head = (ch->head + 1) % ch->capacity;
+        ch->len--;
+
+        /* that freed a slot: move the first blocked sender's value into it */
+        sender = _coro_waiter_pop(&ch->send_head, &ch->send_tail);
+        if (sender != NULL)
+        {
+            ch->buffer[(ch->head + ch->len) % ch->capacity] = sender->transfer;
+            ch->len++;
+        }
+        spin_unlock(&ch->lock);
+    }
+    else if ((sender = _coro_waiter_pop(&ch->send_head, &ch->send_tail)) != NULL)
+    {
+        /* unbuffered channel: take the value straight from the sender */
+        spin_unlock(&ch->lock);
+        *out = sender->transfer;
+    }
+    else if (ch->closed)
+    {
+        spin_unlock(&ch->lock);
+        return -1;
+    }
+    else
+    {
+        _coro_waiter_push(&ch->recv_head, &ch->recv_tail, self);
+        _coro_block(self, &ch->lock);
+        if (self->transfer_status == 0)
+        {
+            *out = self->transfer;
+        }
+        return self->transfer_status;
+    }
+
+    if (sender != NULL)
+    {
+        sender->transfer_status = 0;
+        _coro_make_ready(sender->rt, sender);
+    }
+    return 0;
+}
+
+void coro_channel_close(struct coro_channel *ch)
+{
+    spin_lock(&ch->lock);
+    ch->closed = 1;
+    struct coro *senders = ch->send_head;
+    struct coro *receivers = ch->recv_head;
+    ch->send_head = ch->send_tail = NULL;
+    ch->recv_head = ch->recv_tail = NULL;
+    spin_unlock(&ch->lock);
+
+    /* `next' is reused by the run queue, so read it before making each one ready */
+    while (senders != NULL)
+    {
+        struct coro *next = senders->next;
+        senders->transfer_status = -1;
+        _coro_make_ready(senders->rt, senders);
+        senders = next;
+    }
+    while (receivers != NULL)
+    {
+        struct coro *next = receivers->next;
+        receivers->transfer_status = -1;
+        _coro_make_ready(receivers->rt, receivers);
+        receivers = next;
+    }
+}
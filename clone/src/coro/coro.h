@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../thread/spinlock.h"
+#include "../thread/thread.h"
+#include "context.h"
+#include "stack.h"
+
+/// Default cap on live coroutines in a runtime.
+#define _CORO_MAX_DEFAULT (256 * 1024)
+/// Stack size of the runtime's worker threads. Coroutines run on their own stacks, so this only holds the scheduler loop.
+#define _CORO_WORKER_STACK_SIZE (64 * 1024)
+/// Number of empty run queue checks a worker spins through before parking on the futex.
+#define _CORO_SPIN_ROUNDS 64
+
+enum coro_state
+{
+    CORO_READY,
+    CORO_RUNNING,
+    /// Waiting on a channel. Only a channel operation makes it ready again.
+    CORO_BLOCKED,
+    CORO_DONE,
+};
+
+struct coro;
+struct coro_runtime;
+
+typedef void (*coro_fn)(struct coro *self, void *arg);
+
+/// A stackful coroutine. The struct lives at the top of its own stack, so creating one allocates nothing else.
+struct coro
+{
+    struct coro_context ctx;
+    /// Context of whoever resumed this coroutine. Yielding switches back to it.
+    struct coro_context *caller;
+    coro_fn fn;
+    void *arg;
+    struct coro_stack_pool *pool;
+    char *stack;
+    enum coro_state state;
+    /// Owning runtime, or NULL for a coroutine driven by hand with `coro_resume'.
+    struct coro_runtime *rt;
+    /// Link in a run queue or channel wait queue.
+    struct coro *next;
+    /// Value being handed over by a blocked channel operation, and its result once woken (0, or -1 if the channel was closed).
+    void *transfer;
+    int transfer_status;
+    /// Lock the scheduler releases once this coroutine has switched out to block.
+    spinlock_t *unlock_after_switch;
+};
+
+/// Create a suspended coroutine running `fn(self, arg)' on a stack from `pool'. Returns NULL if no stack is available.
+struct coro *coro_create(struct coro_stack_pool *pool, coro_fn fn, void *arg);
+/// Run the coroutine until it yields or finishes. Returns 1 if it can be resumed again, 0 if it has finished.
+/// Must not be used on coroutines owned by a runtime.
+int coro_resume(struct coro *co);
+/// Suspend the calling coroutine, switching back to whoever resumed it. In a runtime, it is rescheduled behind other ready coroutines.
+void coro_yield(struct coro *self);
+/// Return the coroutine's stack to its pool. The coroutine must not be running.
+void coro_destroy(struct coro *co);
+
+struct coro_worker
+{
+    struct coro_runtime *rt;
+    uint32_t id;
+    struct thread thread;
+};
+
+/// Attributes for `coro_runtime_create'. Zero fields fall back to the defaults.
+struct coro_runtime_attr
+{
+    uint32_t worker_count;
+    size_t stack_size;
+    /// Guard region below each stack. Use `_CORO_NO_GUARD' to rely on the stack canary only.
+    size_t guard_size;
+    uint32_t max_coroutines;
+};
+
+/// Passed as `guard_size' to get stacks without a guard region (see stack.h).
+#define _CORO_NO_GUARD ((size_t)-1)
+
+/// An M:N scheduler running coroutines on a fixed set of clone3 worker threads (see thread.h, whose restrictions on
+/// libc and TLS apply to coroutine bodies). Coroutines are detached: their stacks go back to the pool once they finish.
+struct coro_runtime
+{
+    struct coro_stack_pool stacks;
+    struct coro_worker *workers;
+    uint32_t worker_count;
+    spinlock_t rq_lock;
+    struct coro *rq_head;
+    struct coro *rq_tail;
+    alignas(64) _Atomic uint32_t wake_seq;
+    _Atomic uint32_t sleepers;
+    /// Coroutines spawned but not yet finished. `coro_runtime_wait' sleeps on this.
+    _Atomic uint32_t live;
+    _Atomic uint32_t shutdown;
+};
+
+/// Create a runtime and start its workers. `attr' may be NULL. Returns NULL and sets errno on failure.
+/// To free this runtime, call coro_runtime_destroy.
+struct coro_runtime *coro_runtime_create(const struct coro_runtime_attr *attr);
+/// Start `fn(self, arg)' as a new coroutine in the runtime. Safe to call from any thread or coroutine.
+/// Returns NULL if the coroutine limit has been reached or no memory is available. errno is not set either way,
+/// because coroutines run on workers that share errno with the thread that created the runtime.
+struct coro *coro_spawn(struct coro_runtime *rt, coro_fn fn, void *arg);
+/// Block the calling (non-runtime) thread until every spawned coroutine has finished.
+void coro_runtime_wait(struct coro_runtime *rt);
+/// Stop and join the workers and free the runtime. Coroutines still alive at this point are leaked with their stacks unmapped.
+void coro_runtime_destroy(struct coro_runtime *rt);
+
+/// A channel passing pointers between coroutines of the same runtime.
+/// With a capacity of 0, every send waits for a matching receive.
+struct coro_channel
+{
+    spinlock_t lock;
+    void **buffer;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t len;
+    int closed;
+    struct coro *send_head;
+    struct coro *send_tail;
+    struct coro *recv_head;
+    struct coro *recv_tail;
+};
+
+/// Initialise a channel using caller-provided storage for `capacity' buffered values (`buffer' may be NULL if `capacity' is 0).
+void coro_channel_init(struct coro_channel *ch, void **buffer, uint32_t capacity);
+/// Send `value', blocking the coroutine while the channel is full. Returns 0, or -1 if the channel is closed.
+int coro_channel_send(struct coro *self, struct coro_channel *ch, void *value);
+/// Receive a value into `out', blocking the coroutine while the channel is empty. Returns 0, or -1 once the channel is closed and drained.
+int coro_channel_recv(struct coro *self, struct coro_channel *ch, void **out);
+/// Close the channel. Blocked senders fail, blocked receivers fail once the buffer is drained.
+void coro_channel_close(struct coro_channel *ch);
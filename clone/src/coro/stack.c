@@ -0,0 +1,141 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../thread/raw_syscall.h"
+#include "stack.h"
+
+/* the first page of each slab is a header linking the slabs together, followed by `_CORO_SLAB_STACKS' slots.
+   each slot is laid out from low to high as [guard][canary word, rest of the usable stack] */
+struct coro_slab_header
+{
+    char *next;
+    size_t size;
+};
+
+static size_t _page_size(void)
+{
+    return sysconf(_SC_PAGESIZE);
+}
+
+static size_t _page_round(size_t size)
+{
+    size_t page = _page_size();
+    return (size + page - 1) & ~(page - 1);
+}
+
+int coro_stack_pool_init(struct coro_stack_pool *p, size_t stack_size, size_t guard_size, uint32_t max_stacks)
+{
+    memset(p, 0, sizeof(*p));
+    p->lock = (spinlock_t)SPINLOCK_INIT;
+    p->stack_size = _page_round(stack_size);
+    p->guard_size = _page_round(guard_size);
+    p->slot_size = p->guard_size + p->stack_size;
+    p->max_stacks = max_stacks;
+    if (p->stack_size == 0 || max_stacks == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* maps a new slab and makes it the one stacks are carved from. caller holds the lock.
+   this runs when coroutines spawn coroutines, so it uses raw system calls to leave the shared errno alone */
+static int _coro_slab_new(struct coro_stack_pool *p)
+{
+    size_t size = _page_size() + p->slot_size * _CORO_SLAB_STACKS;
+    long ret = raw_syscall(SYS_mmap, 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE,
+                           -1, 0);
+    if (raw_syscall_failed(ret))
+    {
+        return -1;
+    }
+    char *map = (char *)ret;
+
+    if (p->guard_size > 0)
+    {
+        char *slot = map + _page_size();
+        for (int i = 0; i < _CORO_SLAB_STACKS; i++, slot += p->slot_size)
+        {
+            if (raw_syscall_failed(raw_syscall(SYS_mprotect, (long)slot, p->guard_size, PROT_NONE, 0, 0, 0)))
+            {
+                raw_syscall(SYS_munmap, (long)map, size, 0, 0, 0, 0);
+                return -1;
+            }
+        }
+    }
+
+    struct coro_slab_header *h = (struct coro_slab_header *)map;
+    h->next = p->slabs;
+    h->size = size;
+    p->slabs = map;
+    p->slab_next = map + _page_size();
+    p->slab_left = _CORO_SLAB_STACKS;
+    return 0;
+}
+
+char *coro_stack_get(struct coro_stack_pool *p)
+{
+    spin_lock(&p->lock);
+    if (p->in_use >= p->max_stacks)
+    {
+        spin_unlock(&p->lock);
+        return NULL;
+    }
+
+    char *stack = p->free_list;
+    if (stack != NULL)
+    {
+        p->free_list = *(void **)stack;
+    }
+    else
+    {
+        if (p->slab_left == 0 && _coro_slab_new(p) != 0)
+        {
+            spin_unlock(&p->lock);
+            return NULL;
+        }
+        stack = p->slab_next + p->guard_size;
+        p->slab_next += p->slot_size;
+        p->slab_left--;
+        p->carved++;
+    }
+    p->in_use++;
+    spin_unlock(&p->lock);
+
+    *(uint64_t *)stack = _CORO_STACK_CANARY;
+    return stack;
+}
+
+void coro_stack_put(struct coro_stack_pool *p, char *stack)
+{
+    spin_lock(&p->lock);
+    *(void **)stack = p->free_list;
+    p->free_list = stack;
+    p->in_use--;
+    spin_unlock(&p->lock);
+}
+
+int coro_stack_intact(const char *stack)
+{
+    return *(const uint64_t *)stack == _CORO_STACK_CANARY;
+}
+
+void coro_stack_pool_destroy(struct coro_stack_pool *p)
+{
+    char *slab = p->slabs;
+    while (slab != NULL)
+    {
+        struct coro_slab_header *h = (struct coro_slab_header *)slab;
+        char *next = h->next;
+        munmap(slab, h->size);
+        slab = next;
+    }
+    p->slabs = NULL;
+    p->free_list = NULL;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../thread/spinlock.h"
+
+/// Default usable stack size of a coroutine.
+#define _CORO_STACK_SIZE_DEFAULT (16 * 1024)
+/// Default size of the inaccessible guard region below each coroutine stack.
+#define _CORO_GUARD_SIZE_DEFAULT (4 * 1024)
+/// Number of stacks carved out of each mapping.
+#define _CORO_SLAB_STACKS 64
+/// Written to the lowest word of every stack and checked on every switch, to catch overflows without a guard region.
+#define _CORO_STACK_CANARY 0x5a17c0de5a17c0deULL
+
+/// A bounded pool of coroutine stacks. Stacks are bump-allocated out of large mappings (slabs) like an arena,
+/// and freed stacks are kept on a free list for reuse; slabs are only unmapped when the pool is destroyed.
+///
+/// Every guarded stack costs two kernel mappings (guard and stack), so the number of guarded stacks is limited
+/// by vm.max_map_count (65530 by default). Use a guard size of 0 for more stacks than that; overflows are
+/// then only caught after the fact by the canary check.
+struct coro_stack_pool
+{
+    spinlock_t lock;
+    size_t stack_size;
+    size_t guard_size;
+    size_t slot_size;
+    uint32_t max_stacks;
+    /// Stacks carved out of slabs so far, free or not.
+    uint32_t carved;
+    /// Stacks currently handed out.
+    uint32_t in_use;
+    /// Free stacks, linked through their lowest usable word.
+    void *free_list;
+    /// Mappings, linked through their first (header) page.
+    char *slabs;
+    /// The slab stacks are currently being carved from, and how many it has left.
+    char *slab_next;
+    uint32_t slab_left;
+};
+
+/// Initialise a pool handing out at most `max_stacks' stacks of `stack_size' usable bytes, each with a `guard_size' guard region.
+/// Sizes are rounded up to whole pages. Returns 0, or -1 and sets errno on failure.
+int coro_stack_pool_init(struct coro_stack_pool *p, size_t stack_size, size_t guard_size, uint32_t max_stacks);
+
+/// Get the lowest usable address of a free stack, or NULL if the pool is exhausted or out of memory.
+/// errno is left untouched, since this may run on runtime workers, which share errno with the thread that created them.
+/// The stack spans `stack_size' bytes from there and has its canary set.
+char *coro_stack_get(struct coro_stack_pool *p);
+/// Return a stack to the pool.
+void coro_stack_put(struct coro_stack_pool *p, char *stack);
+
+/// Check whether the canary at the bottom of `stack' is still intact.
+int coro_stack_intact(const char *stack);
+
+/// Unmap every slab. All stacks must have been returned.
+void coro_stack_pool_destroy(struct coro_stack_pool *p);
@@ -1,31 +1,357 @@
 #define _GNU_SOURCE
 
-#include <errno.h>
-#include <linux/sched.h> /* struct clone_args */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/resource.h>
-#include <sys/syscall.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-int main(int argc, char *argv[])
+#include "coro/coro.h"
+#include "sched/ws.h"
+#include "thread/thread.h"
+
+#define SPAWN_ITERATIONS 20000
+#define FIB_N 32
+/* below this, fib runs serially: a leaf call is then a few microseconds of work */
+#define FIB_CUTOFF 16
+#define SUM_LEN (16 * 1024 * 1024)
+#define SWITCH_ITERATIONS 10000000
+#define CORO_COUNT 100000
+#define CORO_YIELDS 10
+
+static uint64_t now_ns(void)
 {
-    struct rlimit rl;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int add_one(void *arg)
+{
+    atomic_fetch_add_explicit((_Atomic uint64_t *)arg, 1, memory_order_relaxed);
+    return 7;
+}
+
+static void *add_one_pthread(void *arg)
+{
+    atomic_fetch_add_explicit((_Atomic uint64_t *)arg, 1, memory_order_relaxed);
+    return NULL;
+}
 
+/* spawn/join latency of clone3 threads with pooled, guard-paged stacks vs pthread_create/pthread_join */
+static int bench_spawn(void)
+{
+    struct rlimit rl;
     if (getrlimit(RLIMIT_STACK, &rl))
     {
         perror("failed to get max stack size");
         return EXIT_FAILURE;
     }
+    printf("soft stack size limit: %luB, clone3 thread stack: %dB + %dB guard\n", rl.rlim_cur,
+           _THREAD_STACK_SIZE_DEFAULT, _THREAD_GUARD_SIZE_DEFAULT);
+
+    _Atomic uint64_t counter = 0;
+    struct thread t;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < SPAWN_ITERATIONS; i++)
+    {
+        if (thread_spawn(&t, add_one, &counter, NULL) != 0)
+        {
+            perror("thread_spawn");
+            return EXIT_FAILURE;
+        }
+        if (thread_join(&t) != 7)
+        {
+            fprintf(stderr, "unexpected thread return value\n");
+            return EXIT_FAILURE;
+        }
+    }
+    uint64_t clone_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < SPAWN_ITERATIONS; i++)
+    {
+        pthread_t pt;
+        if (pthread_create(&pt, NULL, add_one_pthread, &counter) != 0)
+        {
+            perror("pthread_create");
+            return EXIT_FAILURE;
+        }
+        pthread_join(pt, NULL);
+    }
+    uint64_t pthread_ns = now_ns() - start;
+
+    if (counter != 2 * SPAWN_ITERATIONS)
+    {
+        fprintf(stderr, "lost thread runs: %lu\n", counter);
+        return EXIT_FAILURE;
+    }
+
+    printf("spawn+join: clone3 %.0fns, pthread %.0fns (%d iterations)\n", (double)clone_ns / SPAWN_ITERATIONS,
+           (double)pthread_ns / SPAWN_ITERATIONS, SPAWN_ITERATIONS);
+
+    thread_stack_pool_trim();
+    return EXIT_SUCCESS;
+}
+
+static uint64_t fib_serial(uint32_t n)
+{
+    return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+struct fib_args
+{
+    uint32_t n;
+    uint64_t result;
+};
+
+static void fib_task(struct ws_worker *w, void *arg)
+{
+    struct fib_args *fa = arg;
+    if (fa->n < FIB_CUTOFF)
+    {
+        fa->result = fib_serial(fa->n);
+        return;
+    }
+
+    struct fib_args left = {fa->n - 1, 0};
+    struct fib_args right = {fa->n - 2, 0};
+    struct ws_group g = {0};
+    struct ws_task t;
+    ws_spawn(w, &g, &t, fib_task, &left);
+    fib_task(w, &right);
+    ws_sync(w, &g);
+    fa->result = left.result + right.result;
+}
+
+struct sum_args
+{
+    const uint32_t *data;
+    _Atomic uint64_t total;
+};
+
+static void sum_body(struct ws_worker *w, size_t begin, size_t end, void *arg)
+{
+    struct sum_args *sa = arg;
+    uint64_t total = 0;
+    for (size_t i = begin; i < end; i++)
+    {
+        total += sa->data[i];
+    }
+    atomic_fetch_add_explicit(&sa->total, total, memory_order_relaxed);
+}
+
+static void sum_task(struct ws_worker *w, void *arg)
+{
+    struct sum_args *sa = arg;
+    ws_parallel_for(w, 0, SUM_LEN, 0, sum_body, sa);
+}
+
+/* recursive fork/join and parallel_for speedup of the work-stealing scheduler over a serial run */
+static int bench_sched(void)
+{
+    uint32_t workers = sysconf(_SC_NPROCESSORS_ONLN);
+    struct ws_pool *pool = ws_pool_create(workers);
+    if (pool == NULL)
+    {
+        perror("ws_pool_create");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t start = now_ns();
+    uint64_t expected = fib_serial(FIB_N);
+    uint64_t serial_ns = now_ns() - start;
+
+    struct fib_args fa = {FIB_N, 0};
+    start = now_ns();
+    ws_run(pool, fib_task, &fa);
+    uint64_t parallel_ns = now_ns() - start;
 
-    printf("soft stack size limit: %luB\n", rl.rlim_cur);
-    void *child_stack = malloc(rl.rlim_cur);
+    if (fa.result != expected)
+    {
+        fprintf(stderr, "fib(%d): got %lu, expected %lu\n", FIB_N, fa.result, expected);
+        return EXIT_FAILURE;
+    }
+    printf("fib(%d) on %u workers: serial %.2fms, work-stealing %.2fms (%.2fx)\n", FIB_N, workers, serial_ns / 1e6,
+           parallel_ns / 1e6, (double)serial_ns / parallel_ns);
 
-    /* we use clone3 over clone because it has a more modern API with additional flexibility
-       however glibc does not expose a wrapper for clone3 so we invoke it manually via `syscall' */
+    uint32_t *data = malloc(sizeof(uint32_t) * SUM_LEN);
+    if (data == NULL)
+    {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < SUM_LEN; i++)
+    {
+        data[i] = i & 0xff;
+    }
 
-    struct clone_args cl_args;
-    size_t size = sizeof(cl_args);
+    start = now_ns();
+    uint64_t serial_total = 0;
+    for (size_t i = 0; i < SUM_LEN; i++)
+    {
+        serial_total += data[i];
+    }
+    serial_ns = now_ns() - start;
+
+    struct sum_args sa = {data, 0};
+    start = now_ns();
+    ws_run(pool, sum_task, &sa);
+    parallel_ns = now_ns() - start;
+
+    if (sa.total != serial_total)
+    {
+        fprintf(stderr, "parallel_for sum: got %lu, expected %lu\n", (uint64_t)sa.total, serial_total);
+        return EXIT_FAILURE;
+    }
+    printf("parallel_for sum of %d: serial %.2fms, work-stealing %.2fms (%.2fx)\n", SUM_LEN, serial_ns / 1e6,
+           parallel_ns / 1e6, (double)serial_ns / parallel_ns);
+
+    free(data);
+    ws_pool_destroy(pool);
+    return EXIT_SUCCESS;
+}
+
+static void yield_forever(struct coro *self, void *arg)
+{
+    for (;;)
+    {
+        coro_yield(self);
+    }
+}
+
+struct coro_bench
+{
+    struct coro_channel results;
+    void *results_buffer[1024];
+    _Atomic uint64_t received;
+};
+
+static void producer(struct coro *self, void *arg)
+{
+    struct coro_bench *b = arg;
+    for (int i = 0; i < CORO_YIELDS; i++)
+    {
+        coro_yield(self);
+    }
+    coro_channel_send(self, &b->results, (void *)1);
+}
+
+static void consumer(struct coro *self, void *arg)
+{
+    struct coro_bench *b = arg;
+    void *value;
+    for (int i = 0; i < CORO_COUNT; i++)
+    {
+        if (coro_channel_recv(self, &b->results, &value) == 0)
+        {
+            atomic_fetch_add_explicit(&b->received, (uintptr_t)value, memory_order_relaxed);
+        }
+    }
+    coro_channel_close(&b->results);
+}
+
+/* raw context switch cost, then 100k coroutines yielding and reporting back over a channel */
+static int bench_coro(void)
+{
+    struct coro_stack_pool pool;
+    if (coro_stack_pool_init(&pool, _CORO_STACK_SIZE_DEFAULT, _CORO_GUARD_SIZE_DEFAULT, 1) != 0)
+    {
+        perror("coro_stack_pool_init");
+        return EXIT_FAILURE;
+    }
+
+    struct coro *co = coro_create(&pool, yield_forever, NULL);
+    uint64_t start = now_ns();
+    for (int i = 0; i < SWITCH_ITERATIONS; i++)
+    {
+        coro_resume(co);
+    }
+    uint64_t switch_ns = now_ns() - start;
+    coro_destroy(co);
+    coro_stack_pool_destroy(&pool);
+    /* every resume is two switches: into the coroutine and back out */
+    printf("coroutine context switch: %.1fns\n", (double)switch_ns / (2.0 * SWITCH_ITERATIONS));
+
+    /* each guarded stack needs two kernel mappings, which would exceed the default vm.max_map_count,
+       so this many coroutines rely on the stack canary instead */
+    struct coro_runtime_attr attr = {
+        .guard_size = _CORO_NO_GUARD,
+        .max_coroutines = CORO_COUNT + 1,
+    };
+    struct coro_runtime *rt = coro_runtime_create(&attr);
+    if (rt == NULL)
+    {
+        perror("coro_runtime_create");
+        return EXIT_FAILURE;
+    }
+
+    struct coro_bench b = {0};
+    coro_channel_init(&b.results, b.results_buffer, sizeof(b.results_buffer) / sizeof(b.results_buffer[0]));
+
+    start = now_ns();
+    if (coro_spawn(rt, consumer, &b) == NULL)
+    {
+        fprintf(stderr, "coro_spawn: coroutine limit reached or out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < CORO_COUNT; i++)
+    {
+        if (coro_spawn(rt, producer, &b) == NULL)
+        {
+            fprintf(stderr, "coro_spawn: coroutine limit reached or out of memory\n");
+            return EXIT_FAILURE;
+        }
+    }
+    coro_runtime_wait(rt);
+    uint64_t run_ns = now_ns() - start;
+
+    if (b.received != CORO_COUNT)
+    {
+        fprintf(stderr, "lost coroutine results: %lu of %d\n", (uint64_t)b.received, CORO_COUNT);
+        return EXIT_FAILURE;
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%d coroutines x %d yields + channel send on %u workers: %.2fms, %u stacks carved, max rss %ldKiB\n",
+           CORO_COUNT, CORO_YIELDS, rt->worker_count, run_ns / 1e6, rt->stacks.carved, ru.ru_maxrss);
+
+    coro_runtime_destroy(rt);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    /* run a single benchmark by name, or all of them */
+    const char *which = argc > 1 ? argv[1] : NULL;
+
+    if (which == NULL || strcmp(which, "spawn") == 0)
+    {
+        if (bench_spawn() != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    if (which == NULL || strcmp(which, "sched") == 0)
+    {
+        if (bench_sched() != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    if (which == NULL || strcmp(which, "coro") == 0)
+    {
+        if (bench_coro() != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,415 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../thread/futex.h"
+#include "ws.h"
+
+/* the deque follows "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al.), minus resizing:
+   a full deque makes the spawner run the task itself, which is always correct for fork/join */
+
+#define _WS_EMPTY ((struct ws_task *)NULL)
+#define _WS_ABORT ((struct ws_task *)1)
+
+static int _ws_deque_init(struct ws_deque *d)
+{
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    d->buffer = calloc(_WS_DEQUE_CAPACITY, sizeof(*d->buffer));
+    return d->buffer == NULL ? -1 : 0;
+}
+
+static bool _ws_deque_push(struct ws_deque *d, struct ws_task *t)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - top >= _WS_DEQUE_CAPACITY)
+    {
+        return false;
+    }
+
+    atomic_store_explicit(&d->buffer[b & (_WS_DEQUE_CAPACITY - 1)], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+static struct ws_task *_ws_deque_pop(struct ws_deque *d)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (top > b)
+    {
+        /* already empty */
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return _WS_EMPTY;
+    }
+
+    struct ws_task *t = atomic_load_explicit(&d->buffer[b & (_WS_DEQUE_CAPACITY - 1)], memory_order_relaxed);
+    if (top == b)
+    {
+        /* last task: race thieves for it */
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst,
+                                                     memory_order_relaxed))
+        {
+            t = _WS_EMPTY;
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return t;
+}
+
+static struct ws_task *_ws_deque_steal(struct ws_deque *d)
+{
+    int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (top >= b)
+    {
+        return _WS_EMPTY;
+    }
+
+    struct ws_task *t = atomic_load_explicit(&d->buffer[top & (_WS_DEQUE_CAPACITY - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+    {
+        return _WS_ABORT;
+    }
+    return t;
+}
+
+static int64_t _ws_deque_size(struct ws_deque *d)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&d->top, memory_order_relaxed);
+    return b > top ? b - top : 0;
+}
+
+static uint64_t _ws_rand(struct ws_worker *w)
+{
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    return w->rng;
+}
+
+static void _ws_execute(struct ws_worker *w, struct ws_task *t)
+{
+    /* read the group first: once `pending' drops, the spawner may return and the task storage may be gone */
+    struct ws_group *g = t->group;
+    t->fn(w, t->arg);
+    atomic_fetch_sub_explicit(&g->pending, 1, memory_order_release);
+}
+
+/* one round of stealing from random victims */
+static struct ws_task *_ws_steal(struct ws_worker *w)
+{
+    struct ws_pool *p = w->pool;
+    if (p->worker_count < 2)
+    {
+        return _WS_EMPTY;
+    }
+
+    for (uint32_t i = 0; i < p->worker_count; i++)
+    {
+        uint32_t victim = _ws_rand(w) % (p->worker_count - 1);
+        /* skip ourselves */
+        if (victim >= w->id)
+        {
+            victim++;
+        }
+
+        struct ws_task *t = _ws_deque_steal(&p->workers[victim].deque);
+        if (t != _WS_EMPTY && t != _WS_ABORT)
+        {
+            return t;
+        }
+    }
+    return _WS_EMPTY;
+}
+
+static struct ws_task *_ws_find_task(struct ws_worker *w)
+{
+    struct ws_task *t = _ws_deque_pop(&w->deque);
+    if (t != _WS_EMPTY)
+    {
+        return t;
+    }
+    return _ws_steal(w);
+}
+
+static bool _ws_any_work(struct ws_pool *p)
+{
+    for (uint32_t i = 0; i < p->worker_count; i++)
+    {
+        if (_ws_deque_size(&p->workers[i].deque) > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _ws_notify(struct ws_pool *p)
+{
+    /* pairs with the fence in `_ws_park': either the sleeper sees our task when it rechecks, or we see it in `sleepers' */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&p->sleepers, memory_order_relaxed) > 0)
+    {
+        atomic_fetch_add_explicit(&p->wake_seq, 1, memory_order_relaxed);
+        futex_wake(&p->wake_seq, 1);
+    }
+}
+
+static void _ws_park(struct ws_pool *p)
+{
+    uint32_t seq = atomic_load_explicit(&p->wake_seq, memory_order_relaxed);
+    atomic_fetch_add_explicit(&p->sleepers, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!_ws_any_work(p) && !atomic_load_explicit(&p->shutdown, memory_order_relaxed))
+    {
+        futex_wait(&p->wake_seq, seq);
+    }
+
+    atomic_fetch_sub_explicit(&p->sleepers, 1, memory_order_relaxed);
+}
+
+static int _ws_worker_main(void *arg)
+{
+    struct ws_worker *w = arg;
+    struct ws_pool *p = w->pool;
+    uint32_t idle_rounds = 0;
+
+    while (!atomic_load_explicit(&p->shutdown, memory_order_acquire))
+    {
+        struct ws_task *t = _ws_find_task(w);
+        if (t != _WS_EMPTY)
+        {
+            _ws_execute(w, t);
+            idle_rounds = 0;
+            continue;
+        }
+
+        if (++idle_rounds < _WS_SPIN_ROUNDS)
+        {
+            cpu_relax();
+            continue;
+        }
+
+        _ws_park(p);
+        idle_rounds = 0;
+    }
+
+    return 0;
+}
+
+struct ws_pool *ws_pool_create(uint32_t worker_count)
+{
+    if (worker_count == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct ws_pool *p = aligned_alloc(alignof(struct ws_pool), sizeof(struct ws_pool));
+    if (p == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(p, 0, sizeof(*p));
+
+    p->workers = aligned_alloc(alignof(struct ws_worker), sizeof(struct ws_worker) * worker_count);
+    if (p->workers == NULL)
+    {
+        errno = ENOMEM;
+        free(p);
+        return NULL;
+    }
+    memset(p->workers, 0, sizeof(struct ws_worker) * worker_count);
+
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        struct ws_worker *w = &p->workers[i];
+        w->pool = p;
+        w->id = i;
+        w->rng = 0x9e3779b97f4a7c15 * (i + 1);
+        if (_ws_deque_init(&w->deque) != 0)
+        {
+            errno = ENOMEM;
+            p->worker_count = i;
+            ws_pool_destroy(p);
+            return NULL;
+        }
+    }
+    p->worker_count = worker_count;
+
+    /* worker 0 is the thread calling `ws_run', so only the rest get threads of their own */
+    struct thread_attr attr = {
+        .stack_size = _WS_WORKER_STACK_SIZE,
+        .guard_size = _THREAD_GUARD_SIZE_DEFAULT,
+    };
+    for (uint32_t i = 1; i < worker_count; i++)
+    {
+        if (thread_spawn(&p->workers[i].thread, _ws_worker_main, &p->workers[i], &attr) != 0)
+        {
+            int err = errno;
+            /* only join the threads that were actually started */
+            for (uint32_t j = i; j < worker_count; j++)
+            {
+                atomic_store_explicit(&p->workers[j].thread.tid, 0, memory_order_relaxed);
+                p->workers[j].thread.map = NULL;
+            }
+            ws_pool_destroy(p);
+            errno = err;
+            return NULL;
+        }
+    }
+
+    return p;
+}
+
+void ws_run(struct ws_pool *p, ws_fn fn, void *arg)
+{
+    fn(&p->workers[0], arg);
+}
+
+void ws_spawn(struct ws_worker *w, struct ws_group *g, struct ws_task *t, ws_fn fn, void *arg)
+{
+    t->fn = fn;
+    t->arg = arg;
+    t->group = g;
+    atomic_fetch_add_explicit(&g->pending, 1, memory_order_relaxed);
+
+    if (!_ws_deque_push(&w->deque, t))
+    {
+        _ws_execute(w, t);
+        return;
+    }
+    _ws_notify(w->pool);
+}
+
+void ws_sync(struct ws_worker *w, struct ws_group *g)
+{
+    while (atomic_load_explicit(&g->pending, memory_order_acquire) > 0)
+    {
+        /* help out instead of blocking: our own tasks first, then anyone else's */
+        struct ws_task *t = _ws_find_task(w);
+        if (t != _WS_EMPTY)
+        {
+            _ws_execute(w, t);
+        }
+        else
+        {
+            cpu_relax();
+        }
+    }
+}
+
+struct _ws_pfor
+{
+    void (*body)(struct ws_worker *w, size_t begin, size_t end, void *arg);
+    void *arg;
+    size_t grain;
+};
+
+struct _ws_pfor_range
+{
+    struct _ws_pfor *pfor;
+    size_t begin;
+    size_t end;
+};
+
+static void _ws_pfor_run(struct ws_worker *w, struct _ws_pfor *pfor, size_t begin, size_t end);
+
+static void _ws_pfor_task(struct ws_worker *w, void *arg)
+{
+    struct _ws_pfor_range *r = arg;
+    _ws_pfor_run(w, r->pfor, r->begin, r->end);
+}
+
+/* lazy binary splitting: only give away half of the range while our deque is empty (our previous halves got stolen),
+   otherwise nobody is hungry and we keep working through it grain by grain */
+static void _ws_pfor_run(struct ws_worker *w, struct _ws_pfor *pfor, size_t begin, size_t end)
+{
+    /* each split halves the range, so there can be at most one per bit of size_t */
+    struct ws_task tasks[sizeof(size_t) * 8];
+    struct _ws_pfor_range ranges[sizeof(size_t) * 8];
+    struct ws_group g = {0};
+    uint32_t splits = 0;
+
+    while (end - begin > pfor->grain)
+    {
+        if (splits < sizeof(size_t) * 8 && _ws_deque_size(&w->deque) == 0)
+        {
+            size_t mid = begin + (end - begin) / 2;
+            ranges[splits] = (struct _ws_pfor_range){pfor, mid, end};
+            ws_spawn(w, &g, &tasks[splits], _ws_pfor_task, &ranges[splits]);
+            splits++;
+            end = mid;
+        }
+        else
+        {
+            pfor->body(w, begin, begin + pfor->grain, pfor->arg);
+            begin += pfor->grain;
+        }
+    }
+
+    if (begin < end)
+    {
+        pfor->body(w, begin, end, pfor->arg);
+    }
+    ws_sync(w, &g);
+}
+
+void ws_parallel_for(struct ws_worker *w, size_t begin, size_t end, size_t grain,
+                     void (*body)(struct ws_worker *w, size_t begin, size_t end, void *arg), void *arg)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    if (grain == 0)
+    {
+        grain = (end - begin) / ((size_t)w->pool->worker_count * _WS_GRAINS_PER_WORKER);
+        if (grain == 0)
+        {
+            grain = 1;
+        }
+    }
+
+    struct _ws_pfor pfor = {body, arg, grain};
+    _ws_pfor_run(w, &pfor, begin, end);
+}
+
+uint32_t ws_worker_id(struct ws_worker *w)
+{
+    return w->id;
+}
+
+void ws_pool_destroy(struct ws_pool *p)
+{
+    atomic_store_explicit(&p->shutdown, 1, memory_order_release);
+    atomic_fetch_add_explicit(&p->wake_seq, 1, memory_order_seq_cst);
+    futex_wake(&p->wake_seq, INT32_MAX);
+
+    for (uint32_t i = 1; i < p->worker_count; i++)
+    {
+        if (p->workers[i].thread.map != NULL)
+        {
+            thread_join(&p->workers[i].thread);
+        }
+    }
+
+    for (uint32_t i = 0; i < p->worker_count; i++)
+    {
+        free(p->workers[i].deque.buffer);
+    }
+    free(p->workers);
+    free(p);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../thread/thread.h"
+
+/// Capacity of each worker's deque (a power of two). When a deque is full, `ws_spawn' runs the task immediately instead.
+#define _WS_DEQUE_CAPACITY 4096
+/// Stack size of each worker thread. Waiting in `ws_sync' runs other tasks on the same stack, so it needs some depth.
+#define _WS_WORKER_STACK_SIZE (1024 * 1024)
+/// Number of failed steal rounds a worker spins through before parking on the futex.
+#define _WS_SPIN_ROUNDS 64
+/// `ws_parallel_for' aims for this many grains per worker when picking a grain size itself.
+#define _WS_GRAINS_PER_WORKER 8
+
+struct ws_worker;
+
+/// A task body. `w' is the worker running it and must be passed on to any `ws_*' call the task makes.
+typedef void (*ws_fn)(struct ws_worker *w, void *arg);
+
+/// Counts the outstanding tasks spawned into it. Zero-initialise it, spawn into it, then `ws_sync' it.
+struct ws_group
+{
+    _Atomic uint32_t pending;
+};
+
+/// A spawned task. The spawner provides the storage (usually on its own stack),
+/// which must stay valid until the group it was spawned into has been synced.
+struct ws_task
+{
+    ws_fn fn;
+    void *arg;
+    struct ws_group *group;
+};
+
+/// A Chase-Lev work-stealing deque. The owning worker pushes and pops at the bottom, thieves take from the top.
+struct ws_deque
+{
+    alignas(64) _Atomic int64_t top;
+    alignas(64) _Atomic int64_t bottom;
+    _Atomic(struct ws_task *) *buffer;
+};
+
+struct ws_worker
+{
+    struct ws_deque deque;
+    struct ws_pool *pool;
+    uint32_t id;
+    /// xorshift state used to pick steal victims.
+    uint64_t rng;
+    struct thread thread;
+};
+
+/// A fixed set of workers running fork/join tasks with work stealing.
+/// Worker 0 is whichever thread calls `ws_run'; the others are clone3 threads (see thread.h) that park on a futex when idle.
+/// Tasks run on those threads, so the thread.h restrictions on libc and TLS apply to task bodies.
+struct ws_pool
+{
+    struct ws_worker *workers;
+    uint32_t worker_count;
+    /// Bumped and futex-woken whenever work shows up while workers are parked.
+    alignas(64) _Atomic uint32_t wake_seq;
+    _Atomic uint32_t sleepers;
+    _Atomic uint32_t shutdown;
+};
+
+/// Create a pool of `worker_count' workers (including the thread that will call `ws_run'). Returns NULL and sets errno on failure.
+/// To free this pool, call ws_pool_destroy.
+struct ws_pool *ws_pool_create(uint32_t worker_count);
+
+/// Run `fn(arg)' as the root task on the calling thread, which acts as worker 0 until it returns.
+/// Only one thread may be inside `ws_run' for a pool at a time.
+void ws_run(struct ws_pool *p, ws_fn fn, void *arg);
+
+/// Make `fn(arg)' available to run in parallel with the caller, counted in `g'. `t' is the task's storage.
+void ws_spawn(struct ws_worker *w, struct ws_group *g, struct ws_task *t, ws_fn fn, void *arg);
+/// Wait until every task spawned into `g' has finished. While waiting, the worker runs its own and stolen tasks.
+void ws_sync(struct ws_worker *w, struct ws_group *g);
+
+/// Run `body' over [begin, end) in parallel, in pieces of at least `grain' indices, and return once all of them are done.
+/// Ranges are only split while the worker's deque is empty, i.e. while other workers are taking its work,
+/// so the actual piece size adapts to the load. A `grain' of 0 picks one based on the range and worker count.
+/// `body' runs on the clone3 workers, which share the `ws_run' caller's malloc thread cache (see thread.h), so it must not
+/// allocate or free: `vec_map'-style bodies that malloc a result per element cannot run on this pool. Allocate outputs
+/// up front and have `body' write into them instead.
+void ws_parallel_for(struct ws_worker *w, size_t begin, size_t end, size_t grain,
+                     void (*body)(struct ws_worker *w, size_t begin, size_t end, void *arg), void *arg);
+
+/// Get the id of a worker, from 0 to worker_count - 1.
+uint32_t ws_worker_id(struct ws_worker *w);
+
+/// Stop and join all worker threads and free the pool.
+void ws_pool_destroy(struct ws_pool *p);
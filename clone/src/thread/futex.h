@@ -0,0 +1,46 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#include "raw_syscall.h"
+
+/* glibc does not expose futex either, and `syscall' reports errors through errno, which threads from `thread_spawn'
+   share with their creator. so these go through `raw_syscall' and return -errno on failure.
+   the non-private operations are used because the kernel wakes CLONE_CHILD_CLEARTID waiters with a shared FUTEX_WAKE */
+
+static inline long _futex_syscall(_Atomic uint32_t *addr, int op, uint32_t val, const struct timespec *timeout)
+{
+    return raw_syscall(SYS_futex, (long)addr, op, val, (long)timeout, 0, 0);
+}
+
+/// Sleep while `*addr' still holds `expected'. May return spuriously. Returns 0, or -errno.
+static inline long futex_wait(_Atomic uint32_t *addr, uint32_t expected)
+{
+    return _futex_syscall(addr, FUTEX_WAIT, expected, NULL);
+}
+
+/// Sleep while `*addr' still holds `expected', for at most `timeout'. May return spuriously. Returns 0, or -errno.
+static inline long futex_wait_timeout(_Atomic uint32_t *addr, uint32_t expected, const struct timespec *timeout)
+{
+    return _futex_syscall(addr, FUTEX_WAIT, expected, timeout);
+}
+
+/// Wake up to `count' threads sleeping on `addr'. Returns the number woken, or -errno.
+static inline long futex_wake(_Atomic uint32_t *addr, int count)
+{
+    return _futex_syscall(addr, FUTEX_WAKE, count, NULL);
+}
+
+/// Hint to the CPU that we are spinning.
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield" ::: "memory");
+#endif
+}
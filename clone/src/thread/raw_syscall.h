@@ -0,0 +1,38 @@
+#pragma once
+
+/* `syscall' and the libc wrappers report errors through errno, which threads from `thread_spawn' share with their
+   creator. code that can run on those threads issues system calls through here instead, which returns -errno on failure */
+
+/// Issue system call `nr' with up to six arguments. Returns the raw result, which is -errno on failure.
+static inline long raw_syscall(long nr, long a0, long a1, long a2, long a3, long a4, long a5)
+{
+#if defined(__x86_64__)
+    long ret;
+    register long r10 __asm__("r10") = a3;
+    register long r8 __asm__("r8") = a4;
+    register long r9 __asm__("r9") = a5;
+    __asm__ volatile("syscall"
+                     : "=a"(ret)
+                     : "a"(nr), "D"(a0), "S"(a1), "d"(a2), "r"(r10), "r"(r8), "r"(r9)
+                     : "rcx", "r11", "memory");
+    return ret;
+#elif defined(__aarch64__)
+    register long x0 __asm__("x0") = a0;
+    register long x1 __asm__("x1") = a1;
+    register long x2 __asm__("x2") = a2;
+    register long x3 __asm__("x3") = a3;
+    register long x4 __asm__("x4") = a4;
+    register long x5 __asm__("x5") = a5;
+    register long x8 __asm__("x8") = nr;
+    __asm__ volatile("svc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x3), "r"(x4), "r"(x5), "r"(x8) : "memory");
+    return x0;
+#else
+#error "raw system calls are only implemented for x86-64 and aarch64"
+#endif
+}
+
+/// Check whether a raw system call result is an error, as opposed to e.g. an address returned by mmap.
+static inline int raw_syscall_failed(long ret)
+{
+    return (unsigned long)ret > -4096UL;
+}
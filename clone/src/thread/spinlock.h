@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdatomic.h>
+
+#include "futex.h"
+
+/// A test-and-test-and-set spinlock for critical sections that are only a few instructions long.
+/// Unlike pthread mutexes it does not depend on the calling thread's TLS, so it is safe on `thread_spawn' threads.
+typedef struct
+{
+    atomic_flag flag;
+} spinlock_t;
+
+#define SPINLOCK_INIT {ATOMIC_FLAG_INIT}
+
+static inline void spin_lock(spinlock_t *l)
+{
+    while (atomic_flag_test_and_set_explicit(&l->flag, memory_order_acquire))
+    {
+        cpu_relax();
+    }
+}
+
+static inline void spin_unlock(spinlock_t *l)
+{
+    atomic_flag_clear_explicit(&l->flag, memory_order_release);
+}
@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/sched.h> /* struct clone_args */
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "futex.h"
+#include "spinlock.h"
+#include "thread.h"
+
+/* free stacks are linked through a node stored at the top of their (writable) stack region */
+struct thread_stack_node
+{
+    struct thread_stack_node *next;
+    char *map;
+    size_t map_size;
+    size_t guard_size;
+};
+
+/* the critical sections are a handful of pointer updates, so a spinlock is fine */
+static struct
+{
+    spinlock_t lock;
+    struct thread_stack_node *head;
+    uint32_t count;
+} _stack_pool = {
+    .lock = SPINLOCK_INIT,
+};
+
+static size_t _page_round(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+static struct thread_stack_node *_stack_node(char *map, size_t map_size)
+{
+    return (struct thread_stack_node *)(map + map_size) - 1;
+}
+
+/* takes a pooled stack with the same layout, or maps a new one */
+static char *_stack_get(size_t map_size, size_t guard_size)
+{
+    spin_lock(&_stack_pool.lock);
+    struct thread_stack_node **link = &_stack_pool.head;
+    while (*link != NULL)
+    {
+        struct thread_stack_node *n = *link;
+        if (n->map_size == map_size && n->guard_size == guard_size)
+        {
+            *link = n->next;
+            _stack_pool.count--;
+            spin_unlock(&_stack_pool.lock);
+            return n->map;
+        }
+        link = &n->next;
+    }
+    spin_unlock(&_stack_pool.lock);
+
+    char *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    /* stacks grow down, so the guard region sits at the low end: overflowing faults instead of corrupting memory */
+    if (guard_size > 0 && mprotect(map, guard_size, PROT_NONE) != 0)
+    {
+        int err = errno;
+        munmap(map, map_size);
+        errno = err;
+        return NULL;
+    }
+
+    return map;
+}
+
+static void _stack_put(char *map, size_t map_size, size_t guard_size)
+{
+    spin_lock(&_stack_pool.lock);
+    if (_stack_pool.count >= _THREAD_STACK_POOL_MAX)
+    {
+        spin_unlock(&_stack_pool.lock);
+        munmap(map, map_size);
+        return;
+    }
+
+    struct thread_stack_node *n = _stack_node(map, map_size);
+    n->map = map;
+    n->map_size = map_size;
+    n->guard_size = guard_size;
+    n->next = _stack_pool.head;
+    _stack_pool.head = n;
+    _stack_pool.count++;
+    spin_unlock(&_stack_pool.lock);
+}
+
+/* first (and only) C frame of a new thread. its return value is passed to SYS_exit by the clone3 stub */
+__attribute__((noinline, used)) static int _thread_start(struct thread *t)
+{
+    t->ret = t->fn(t->arg);
+    return t->ret;
+}
+
+/* glibc does not expose a wrapper for clone3, and `syscall' cannot be used either: the child starts on an empty stack,
+   so it has no frame to return into. the child therefore never leaves this asm block: it calls `_thread_start' and exits */
+static long _thread_clone3(struct clone_args *args, struct thread *t)
+{
+#if defined(__x86_64__)
+    long ret;
+    register struct thread *r12 __asm__("r12") = t;
+    register int (*r13)(struct thread *) __asm__("r13") = _thread_start;
+    __asm__ volatile(
+        "syscall\n\t"
+        "test %%rax, %%rax\n\t"
+        "jnz 1f\n\t"
+        /* child: clear the frame pointer so backtraces end here */
+        "xor %%ebp, %%ebp\n\t"
+        "mov %%r12, %%rdi\n\t"
+        "call *%%r13\n\t"
+        "mov %%eax, %%edi\n\t"
+        "mov %[sys_exit], %%eax\n\t"
+        "syscall\n\t"
+        "hlt\n"
+        "1:"
+        : "=a"(ret)
+        : "a"((long)SYS_clone3), "D"(args), "S"(sizeof(*args)), "r"(r12), "r"(r13), [sys_exit] "i"(SYS_exit)
+        : "rcx", "r11", "memory");
+    return ret;
+#elif defined(__aarch64__)
+    register long x0 __asm__("x0") = (long)args;
+    register long x1 __asm__("x1") = sizeof(*args);
+    register long x8 __asm__("x8") = SYS_clone3;
+    register struct thread *x19 __asm__("x19") = t;
+    register int (*x20)(struct thread *) __asm__("x20") = _thread_start;
+    __asm__ volatile(
+        "svc #0\n\t"
+        "cbnz x0, 1f\n\t"
+        /* child: clear the frame pointer and link register so backtraces end here */
+        "mov x29, #0\n\t"
+        "mov x30, #0\n\t"
+        "mov x0, x19\n\t"
+        "blr x20\n\t"
+        "mov x8, %[sys_exit]\n\t"
+        "svc #0\n\t"
+        "brk #0\n"
+        "1:"
+        : "+r"(x0)
+        : "r"(x1), "r"(x8), "r"(x19), "r"(x20), [sys_exit] "i"(SYS_exit)
+        : "memory");
+    return x0;
+#else
+#error "thread_spawn is only implemented for x86-64 and aarch64"
+#endif
+}
+
+int thread_spawn(struct thread *t, int (*fn)(void *), void *arg, const struct thread_attr *attr)
+{
+    size_t stack_size = _page_round(attr != NULL ? attr->stack_size : _THREAD_STACK_SIZE_DEFAULT);
+    size_t guard_size = _page_round(attr != NULL ? attr->guard_size : _THREAD_GUARD_SIZE_DEFAULT);
+    if (stack_size == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    t->map_size = guard_size + stack_size;
+    t->guard_size = guard_size;
+    t->map = _stack_get(t->map_size, t->guard_size);
+    if (t->map == NULL)
+    {
+        return -1;
+    }
+
+    t->fn = fn;
+    t->arg = arg;
+    t->ret = 0;
+    atomic_store_explicit(&t->tid, 0, memory_order_relaxed);
+
+    /* CLONE_PARENT_SETTID fills in `tid' before clone3 returns, so a join straight after spawning cannot miss the thread.
+       CLONE_CHILD_CLEARTID zeroes it and futex-wakes it once the thread is gone and its stack is no longer in use */
+    struct clone_args cl_args;
+    memset(&cl_args, 0, sizeof(cl_args));
+    cl_args.flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM |
+                    CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+    cl_args.parent_tid = (uint64_t)(uintptr_t)&t->tid;
+    cl_args.child_tid = (uint64_t)(uintptr_t)&t->tid;
+    cl_args.stack = (uint64_t)(uintptr_t)(t->map + guard_size);
+    cl_args.stack_size = stack_size;
+    /* threads must not signal their parent on exit */
+    cl_args.exit_signal = 0;
+
+    long ret = _thread_clone3(&cl_args, t);
+    if (ret < 0)
+    {
+        _stack_put(t->map, t->map_size, t->guard_size);
+        errno = -ret;
+        return -1;
+    }
+
+    return 0;
+}
+
+int thread_join(struct thread *t)
+{
+    uint32_t tid;
+    while ((tid = atomic_load_explicit(&t->tid, memory_order_acquire)) != 0)
+    {
+        futex_wait(&t->tid, tid);
+    }
+
+    _stack_put(t->map, t->map_size, t->guard_size);
+    t->map = NULL;
+    return t->ret;
+}
+
+void thread_stack_pool_trim(void)
+{
+    spin_lock(&_stack_pool.lock);
+    struct thread_stack_node *n = _stack_pool.head;
+    _stack_pool.head = NULL;
+    _stack_pool.count = 0;
+    spin_unlock(&_stack_pool.lock);
+
+    while (n != NULL)
+    {
+        struct thread_stack_node *next = n->next;
+        munmap(n->map, n->map_size);
+        n = next;
+    }
+}
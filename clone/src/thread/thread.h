@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Default usable stack size of a spawned thread.
+#define _THREAD_STACK_SIZE_DEFAULT (64 * 1024)
+/// Default size of the inaccessible guard region below each stack.
+#define _THREAD_GUARD_SIZE_DEFAULT (4 * 1024)
+/// Maximum number of free stacks kept in the stack pool. Stacks freed beyond this are unmapped.
+#define _THREAD_STACK_POOL_MAX 64
+
+/// Optional attributes for `thread_spawn'. Sizes are rounded up to whole pages.
+struct thread_attr
+{
+    size_t stack_size;
+    size_t guard_size;
+};
+
+/// A lightweight thread created directly with clone3.
+/// The caller owns this struct and it must stay valid (and not move) until `thread_join' returns.
+///
+/// These threads share the address space, file descriptors, filesystem info and signal handlers of the creating process,
+/// but they do NOT get their own libc thread-local storage: they run on the TLS block of the thread that spawned them.
+/// Thread functions must therefore not rely on `errno', `thread_local' variables or anything in libc built on them
+/// (stdio locking, malloc arenas, pthread APIs) while the spawning thread may be using them too.
+/// Pass any per-thread state explicitly through `arg' instead.
+struct thread
+{
+    /// Kernel thread id. Set by the kernel before clone3 returns and cleared (with a futex wake) when the thread exits.
+    _Atomic uint32_t tid;
+    int (*fn)(void *);
+    void *arg;
+    /// Return value of `fn', valid after `thread_join'.
+    int ret;
+    /// Whole stack mapping, including the guard region at its low end.
+    char *map;
+    size_t map_size;
+    size_t guard_size;
+};
+
+/// Spawn a thread running `fn(arg)'. `attr' may be NULL to use the default stack and guard sizes.
+/// The stack is taken from the stack pool if a matching one is free, otherwise it is mapped fresh.
+/// Returns 0 on success, or -1 and sets errno on failure.
+int thread_spawn(struct thread *t, int (*fn)(void *), void *arg, const struct thread_attr *attr);
+
+/// Wait for the thread to exit, return its stack to the stack pool and return the value returned by its function.
+int thread_join(struct thread *t);
+
+/// Unmap every stack currently held in the stack pool.
+void thread_stack_pool_trim(void);
@@ -0,0 +1,704 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "loader.h"
+
+/// Windows smaller than this are parsed by a single thread: starting threads would cost more than it saves.
+#define _LOAD_PARALLEL_MIN (64 * 1024)
+
+enum _load_mode {
+	_LOAD_RECORDS,
+	_LOAD_COLUMNS,
+};
+
+// everything one thread needs to parse one line-aligned chunk of a window
+struct _load_chunk {
+	enum _load_mode mode;
+	char delimiter;
+	uint32_t column_count;
+	const char* begin;
+	const char* end;
+	struct arena* arena;
+	struct vector* rows;
+	struct vector** columns;
+	int error;
+};
+
+typedef int (*_load_sink)(struct loader* l, struct _load_chunk* chunk, void* arg);
+
+static uint64_t _load_now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// find the first `delim' or newline in [p, end), or end. this is where most of the parsing time goes,
+// so it compares 16 bytes at a time and only falls back to a byte loop for the tail
+static const char* _load_find(const char* p, const char* end, char delim)
+{
+#if defined(__SSE2__)
+	__m128i d = _mm_set1_epi8(delim);
+	__m128i nl = _mm_set1_epi8('\n');
+	while (end - p >= 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, d), _mm_cmpeq_epi8(chunk, nl)));
+		if (mask != 0)
+		{
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+#elif defined(__ARM_NEON)
+	uint8x16_t d = vdupq_n_u8(delim);
+	uint8x16_t nl = vdupq_n_u8('\n');
+	while (end - p >= 16)
+	{
+		uint8x16_t chunk = vld1q_u8((const uint8_t*)p);
+		uint8x16_t eq = vorrq_u8(vceqq_u8(chunk, d), vceqq_u8(chunk, nl));
+		// NEON has no movemask: narrow every byte to a nibble to get a 64-bit mask instead
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+		if (mask != 0)
+		{
+			return p + (__builtin_ctzll(mask) >> 2);
+		}
+		p += 16;
+	}
+#endif
+	while (p < end && *p != delim && *p != '\n')
+	{
+		p++;
+	}
+	return p;
+}
+
+static char* _load_copy(struct arena* a, const char* s, size_t len)
+{
+	char* copy = arena_alloc_align(a, len + 1, 1);
+	if (copy == NULL)
+	{
+		return NULL;
+	}
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+// parse one field starting at `p'. on return `field' is either a slice of the input (`*copied' false)
+// or an unescaped, NUL-terminated copy in the chunk's arena (`*copied' true, for quoted fields).
+// returns where the next field starts, and sets `*line_end' if this was the last field of its line
+static const char* _load_field(struct _load_chunk* c, const char* p, struct load_field* field, bool* copied, bool* line_end)
+{
+	const char* end = c->end;
+	*copied = false;
+
+	if (p < end && *p == '"')
+	{
+		// quoted: copy it out, turning "" into ". a newline ends the field even inside quotes
+		const char* q = p + 1;
+		const char* close = q;
+		size_t len = 0;
+		while (close < end && *close != '\n' && !(*close == '"' && (close + 1 >= end || close[1] != '"')))
+		{
+			close += (*close == '"') ? 2 : 1;
+			len++;
+		}
+
+		char* copy = arena_alloc_align(c->arena, len + 1, 1);
+		if (copy == NULL)
+		{
+			return NULL;
+		}
+		for (size_t i = 0; i < len; i++)
+		{
+			copy[i] = *q;
+			q += (*q == '"') ? 2 : 1;
+		}
+		copy[len] = '\0';
+
+		field->ptr = copy;
+		field->len = len;
+		*copied = true;
+		// anything between the closing quote and the delimiter is dropped
+		p = _load_find(close, end, c->delimiter);
+	}
+	else
+	{
+		const char* stop = _load_find(p, end, c->delimiter);
+		field->ptr = p;
+		field->len = stop - p;
+		p = stop;
+	}
+
+	*line_end = p >= end || *p == '\n';
+	if (*line_end && !*copied && field->len > 0 && field->ptr[field->len - 1] == '\r')
+	{
+		field->len--;
+	}
+	return p < end ? p + 1 : p;
+}
+
+static int _load_parse_int(struct load_field* f)
+{
+	const char* p = f->ptr;
+	const char* end = p + f->len;
+	while (p < end && *p == ' ')
+	{
+		p++;
+	}
+
+	int sign = 1;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		sign = *p == '-' ? -1 : 1;
+		p++;
+	}
+
+	int value = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+	return sign * value;
+}
+
+// appends `count' elements to `v', reporting failure (vector functions only report it through errno)
+static int _load_extend(struct vector* v, void* data, uint32_t count)
+{
+	uint32_t len = v->len;
+	vec_extend(v, data, count);
+	return v->len == len + count ? 0 : -1;
+}
+
+static int _load_push(struct vector* v, void* data)
+{
+	return _load_extend(v, data, 1);
+}
+
+static int _load_parse_chunk(struct _load_chunk* c)
+{
+	static char empty[] = "";
+	const char* p = c->begin;
+
+	while (p < c->end)
+	{
+		// skip blank lines
+		if (*p == '\n' || (*p == '\r' && p + 1 < c->end && p[1] == '\n'))
+		{
+			p += (*p == '\r') ? 2 : 1;
+			continue;
+		}
+
+		struct record r = {empty, 0, NULL};
+		uint32_t column = 0;
+		bool line_end = false;
+		while (!line_end)
+		{
+			struct load_field f;
+			bool copied;
+			p = _load_field(c, p, &f, &copied, &line_end);
+			if (p == NULL)
+			{
+				return -1;
+			}
+
+			if (c->mode == _LOAD_RECORDS)
+			{
+				if (column == 0)
+				{
+					r.name = copied ? (char*)f.ptr : _load_copy(c->arena, f.ptr, f.len);
+					if (r.name == NULL)
+					{
+						return -1;
+					}
+				}
+				else if (column == 1)
+				{
+					r.age = _load_parse_int(&f);
+				}
+			}
+			else if (column < c->column_count)
+			{
+				if (!copied)
+				{
+					f.ptr = _load_copy(c->arena, f.ptr, f.len);
+					if (f.ptr == NULL)
+					{
+						return -1;
+					}
+				}
+				if (_load_push(c->columns[column], &f) != 0)
+				{
+					return -1;
+				}
+			}
+			column++;
+		}
+
+		if (c->mode == _LOAD_RECORDS)
+		{
+			if (_load_push(c->rows, &r) != 0)
+			{
+				return -1;
+			}
+		}
+		else
+		{
+			// short rows still get a value in every column so that rows line up across columns
+			struct load_field missing = {empty, 0};
+			for (; column < c->column_count; column++)
+			{
+				if (_load_push(c->columns[column], &missing) != 0)
+				{
+					return -1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void* _load_chunk_thread(void* arg)
+{
+	struct _load_chunk* c = arg;
+	// the first chunk is parsed on the caller's thread, where errno may still hold an old error
+	errno = 0;
+	if (_load_parse_chunk(c) != 0)
+	{
+		c->error = errno != 0 ? errno : ENOMEM;
+	}
+	return NULL;
+}
+
+// free everything a chunk owns. its arena is kept for the lifetime of the loader if `keep_arena' is set
+static void _load_chunk_release(struct loader* l, struct _load_chunk* c, bool keep_arena)
+{
+	if (c->arena != NULL)
+	{
+		if (keep_arena)
+		{
+			vec_push(l->arenas, &c->arena);
+		}
+		else
+		{
+			arena_destroy(c->arena);
+		}
+	}
+	if (c->rows != NULL)
+	{
+		vec_destroy(c->rows);
+	}
+	if (c->columns != NULL)
+	{
+		for (uint32_t i = 0; i < c->column_count; i++)
+		{
+			if (c->columns[i] != NULL)
+			{
+				vec_destroy(c->columns[i]);
+			}
+		}
+		free(c->columns);
+	}
+	memset(c, 0, sizeof(*c));
+}
+
+static int _load_chunk_init(struct _load_chunk* c, enum _load_mode mode, char delimiter, uint32_t column_count)
+{
+	memset(c, 0, sizeof(*c));
+	c->mode = mode;
+	c->delimiter = delimiter;
+	c->column_count = column_count;
+	c->arena = arena_create(_LOAD_ARENA_CHUNK_SIZE, 16);
+	if (c->arena == NULL)
+	{
+		return -1;
+	}
+
+	if (mode == _LOAD_RECORDS)
+	{
+		c->rows = vec_new(sizeof(struct record));
+		return c->rows == NULL ? -1 : 0;
+	}
+
+	c->columns = calloc(column_count, sizeof(struct vector*));
+	if (c->columns == NULL)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	for (uint32_t i = 0; i < column_count; i++)
+	{
+		c->columns[i] = vec_new(sizeof(struct load_field));
+		if (c->columns[i] == NULL)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static char _load_delimiter(struct loader* l, const char* path)
+{
+	if (l->options.delimiter != 0)
+	{
+		return l->options.delimiter;
+	}
+
+	size_t len = strlen(path);
+	return (len >= 4 && strcmp(path + len - 4, ".tsv") == 0) ? '\t' : ',';
+}
+
+// the loading pipeline: map a window, split it into line-aligned chunks, parse those in parallel, hand them to `sink' in order
+static int _loader_run(struct loader* l, const char* path, enum _load_mode mode, uint32_t column_count, _load_sink sink,
+	void* sink_arg, bool keep_arenas)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	size_t size = st.st_size;
+	size_t page = sysconf(_SC_PAGESIZE);
+	char delimiter = _load_delimiter(l, path);
+	uint32_t threads = l->options.threads;
+
+	struct _load_chunk* chunks = calloc(threads, sizeof(struct _load_chunk));
+	pthread_t* tids = calloc(threads, sizeof(pthread_t));
+	if (chunks == NULL || tids == NULL)
+	{
+		free(chunks);
+		free(tids);
+		close(fd);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	int ret = 0;
+	size_t offset = 0;
+	bool first = true;
+	while (offset < size && ret == 0)
+	{
+		uint64_t t0 = _load_now_ns();
+
+		// map from the page containing `offset' up to the last complete line in the window.
+		// if a single line does not fit, retry with a bigger window
+		size_t map_start = offset & ~(page - 1);
+		size_t want = l->options.window_size;
+		char* map;
+		size_t map_len;
+		const char* data;
+		const char* lines_end;
+		for (;;)
+		{
+			size_t map_end = offset + want < size ? offset + want : size;
+			map_len = map_end - map_start;
+			// prefault the window so reading it in is charged to mapping rather than showing up as slow parsing
+			map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, map_start);
+			if (map == MAP_FAILED)
+			{
+				ret = -1;
+				break;
+			}
+			madvise(map, map_len, MADV_SEQUENTIAL);
+
+			data = map + (offset - map_start);
+			if (map_end == size)
+			{
+				lines_end = map + map_len;
+				break;
+			}
+			const char* nl = memrchr(data, '\n', map + map_len - data);
+			if (nl != NULL)
+			{
+				lines_end = nl + 1;
+				break;
+			}
+
+			munmap(map, map_len);
+			want *= 2;
+		}
+		if (ret != 0)
+		{
+			break;
+		}
+
+		const char* begin = data;
+		if (first && l->options.has_header)
+		{
+			const char* nl = memchr(begin, '\n', lines_end - begin);
+			begin = nl != NULL ? nl + 1 : lines_end;
+		}
+		first = false;
+
+		// cut the window into roughly equal chunks, moving each cut forward to the next line start
+		uint32_t n = (lines_end - begin) < _LOAD_PARALLEL_MIN ? 1 : threads;
+		size_t approx = (lines_end - begin) / n;
+		const char* cut = begin;
+		uint32_t used = 0;
+		for (uint32_t i = 0; i < n && cut < lines_end; i++)
+		{
+			if (_load_chunk_init(&chunks[used], mode, delimiter, column_count) != 0)
+			{
+				ret = -1;
+				used++;
+				break;
+			}
+
+			const char* chunk_end = lines_end;
+			if (i + 1 < n && cut + approx < lines_end)
+			{
+				const char* nl = memchr(cut + approx, '\n', lines_end - (cut + approx));
+				chunk_end = nl != NULL ? nl + 1 : lines_end;
+			}
+			chunks[used].begin = cut;
+			chunks[used].end = chunk_end;
+			cut = chunk_end;
+			used++;
+		}
+
+		uint64_t t1 = _load_now_ns();
+		l->stats.map_ns += t1 - t0;
+
+		if (ret == 0)
+		{
+			// this thread parses the first chunk itself
+			uint32_t started = 1;
+			for (; started < used; started++)
+			{
+				if (pthread_create(&tids[started], NULL, _load_chunk_thread, &chunks[started]) != 0)
+				{
+					break;
+				}
+			}
+			_load_chunk_thread(&chunks[0]);
+			for (uint32_t i = 1; i < started; i++)
+			{
+				pthread_join(tids[i], NULL);
+			}
+			// chunks whose thread could not be started are parsed here instead
+			for (uint32_t i = started; i < used; i++)
+			{
+				_load_chunk_thread(&chunks[i]);
+			}
+		}
+
+		uint64_t t2 = _load_now_ns();
+		l->stats.parse_ns += t2 - t1;
+
+		for (uint32_t i = 0; i < used; i++)
+		{
+			if (ret == 0 && chunks[i].error != 0)
+			{
+				errno = chunks[i].error;
+				ret = -1;
+			}
+			if (ret == 0)
+			{
+				l->stats.rows += mode == _LOAD_RECORDS ? chunks[i].rows->len : chunks[i].columns[0]->len;
+				if (sink(l, &chunks[i], sink_arg) != 0)
+				{
+					ret = -1;
+				}
+			}
+			_load_chunk_release(l, &chunks[i], keep_arenas && ret == 0);
+		}
+
+		l->stats.append_ns += _load_now_ns() - t2;
+		l->stats.bytes += lines_end - data;
+		l->stats.windows++;
+		offset += lines_end - data;
+		munmap(map, map_len);
+	}
+
+	int err = errno;
+	free(chunks);
+	free(tids);
+	close(fd);
+	errno = err;
+	return ret;
+}
+
+static int _load_intern_names(struct loader* l, struct vector* rows)
+{
+	for (uint32_t i = 0; i < rows->len; i++)
+	{
+		struct record* r = vec_get(rows, i);
+		r->name = (char*)intern_cstr(l->names, r->name);
+		if (r->name == NULL)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int _load_records_sink(struct loader* l, struct _load_chunk* c, void* arg)
+{
+	if (l->options.intern_names && _load_intern_names(l, c->rows) != 0)
+	{
+		return -1;
+	}
+	return _load_extend(arg, c->rows->data, c->rows->len);
+}
+
+struct _load_stream {
+	void (*on_batch)(struct vector* batch, void* arg);
+	void* arg;
+};
+
+static int _load_stream_sink(struct loader* l, struct _load_chunk* c, void* arg)
+{
+	struct _load_stream* s = arg;
+	if (l->options.intern_names && _load_intern_names(l, c->rows) != 0)
+	{
+		return -1;
+	}
+	s->on_batch(c->rows, s->arg);
+	return 0;
+}
+
+static int _load_columns_sink(struct loader* l, struct _load_chunk* c, void* arg)
+{
+	struct vector** columns = arg;
+	for (uint32_t i = 0; i < c->column_count; i++)
+	{
+		if (_load_extend(columns[i], c->columns[i]->data, c->columns[i]->len) != 0)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+struct loader* loader_new(const struct load_options* options)
+{
+	struct loader* l = calloc(1, sizeof(struct loader));
+	if (l == NULL)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (options != NULL)
+	{
+		l->options = *options;
+	}
+	if (l->options.threads == 0)
+	{
+		l->options.threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (l->options.window_size == 0)
+	{
+		l->options.window_size = _LOAD_WINDOW_SIZE_DEFAULT;
+	}
+
+	l->arenas = vec_new(sizeof(struct arena*));
+	l->name_arena = arena_create(_LOAD_ARENA_CHUNK_SIZE, 4);
+	l->names = l->name_arena != NULL ? intern_table_create(l->name_arena) : NULL;
+	if (l->arenas == NULL || l->names == NULL)
+	{
+		loader_destroy(l);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return l;
+}
+
+int loader_load_records(struct loader* l, const char* path, struct vector* out)
+{
+	if (l == NULL || out == NULL || out->elem_size != sizeof(struct record))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	// interned names are copied into the name arena, so the chunk arenas can go as soon as each chunk is appended
+	return _loader_run(l, path, _LOAD_RECORDS, 0, _load_records_sink, out, !l->options.intern_names);
+}
+
+int loader_stream_records(struct loader* l, const char* path, void (*on_batch)(struct vector* batch, void* arg), void* arg)
+{
+	if (l == NULL || on_batch == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	struct _load_stream s = {on_batch, arg};
+	return _loader_run(l, path, _LOAD_RECORDS, 0, _load_stream_sink, &s, false);
+}
+
+int loader_load_columns(struct loader* l, const char* path, struct vector** columns, uint32_t column_count)
+{
+	if (l == NULL || columns == NULL || column_count == 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	for (uint32_t i = 0; i < column_count; i++)
+	{
+		if (columns[i] == NULL || columns[i]->elem_size != sizeof(struct load_field))
+		{
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	return _loader_run(l, path, _LOAD_COLUMNS, column_count, _load_columns_sink, columns, true);
+}
+
+const struct load_stats* loader_stats(struct loader* l)
+{
+	return &l->stats;
+}
+
+void loader_destroy(struct loader* l)
+{
+	if (l == NULL)
+	{
+		errno = EINVAL;
+		return;
+	}
+
+	if (l->arenas != NULL)
+	{
+		for (uint32_t i = 0; i < l->arenas->len; i++)
+		{
+			arena_destroy(*(struct arena**)vec_get(l->arenas, i));
+		}
+		vec_destroy(l->arenas);
+	}
+	if (l->names != NULL)
+	{
+		intern_table_destroy(l->names);
+	}
+	if (l->name_arena != NULL)
+	{
+		arena_destroy(l->name_arena);
+	}
+	free(l);
+}
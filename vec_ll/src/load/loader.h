@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../ll/ll.h"
+#include "../vec/vector.h"
+#include "arena.h"
+#include "intern.h"
+
+/// Default amount of the input file mapped at once. Bounds the loader's memory use for inputs larger than RAM.
+#define _LOAD_WINDOW_SIZE_DEFAULT (256 * 1024 * 1024)
+/// Chunk size of the arenas that field strings are copied into. No single field may be longer than this.
+#define _LOAD_ARENA_CHUNK_SIZE (1024 * 1024)
+
+/// Options for a loader. Zero fields fall back to the defaults.
+struct load_options {
+	/// Field delimiter. 0 picks a tab for files ending in ".tsv" and a comma otherwise.
+	char delimiter;
+	/// Skip the first line of the file.
+	int has_header;
+	/// Threads parsing each window in parallel. 0 uses one per online CPU.
+	uint32_t threads;
+	/// Bytes of the file mapped at once. Grown temporarily if a single line does not fit.
+	size_t window_size;
+	/// Intern record names (see intern.h) so equal names share one pointer and compare by pointer.
+	int intern_names;
+};
+
+/// Time spent in each loading stage and the amount of data that went through.
+/// Throughput of a stage is `bytes' divided by its time.
+struct load_stats {
+	uint64_t bytes;
+	uint64_t rows;
+	uint64_t windows;
+	/// Mapping windows, including reading them in (windows are prefaulted), and finding line and chunk boundaries.
+	uint64_t map_ns;
+	/// Scanning and parsing fields, in parallel. This is wall time, not the sum over threads.
+	uint64_t parse_ns;
+	/// Appending parsed batches to the output.
+	uint64_t append_ns;
+};
+
+/// A single field of a columnar load. `ptr' is NUL-terminated and owned by the loader.
+struct load_field {
+	const char* ptr;
+	uint32_t len;
+};
+
+/// Loads delimited text files (CSV/TSV) through mmap, one window at a time.
+/// Each window is split into line-aligned chunks that are parsed in parallel, with delimiters found 16 bytes at a time (SSE2/NEON),
+/// and field strings copied into per-chunk arenas. Parsed rows are then appended to the output in order, one chunk at a time.
+///
+/// Quoted fields ("a, b" and "" escapes) are supported, but quoted fields spanning several lines are not.
+/// A trailing '\r' on a line is ignored.
+struct loader {
+	struct load_options options;
+	/// Arenas holding the strings of everything loaded so far.
+	struct vector* arenas;
+	struct arena* name_arena;
+	struct intern_table* names;
+	struct load_stats stats;
+};
+
+/// Create a loader. `options' may be NULL. Returns NULL and sets errno on failure.
+/// To free this loader and every string it loaded, call loader_destroy.
+struct loader* loader_new(const struct load_options* options);
+
+/// Load `path' as records, appending them to `out' (a vector with elem_size of sizeof(struct record)).
+/// The first field becomes the name and the second the age; missing fields are empty or 0, extra fields are ignored.
+/// Names stay valid until the loader is destroyed. Returns 0, or -1 and sets errno on failure.
+int loader_load_records(struct loader* l, const char* path, struct vector* out);
+
+/// Load `path' as records, calling `on_batch' with each parsed batch instead of keeping them.
+/// Strings in a batch are only valid during the call, which keeps memory bounded no matter how large the file is.
+/// Returns 0, or -1 and sets errno on failure.
+int loader_stream_records(struct loader* l, const char* path, void (*on_batch)(struct vector* batch, void* arg), void* arg);
+
+/// Load `path' into `column_count' columns: `columns[i]' (a vector with elem_size of sizeof(struct load_field)) gets field i of every row.
+/// Missing fields are empty, extra fields are ignored. Returns 0, or -1 and sets errno on failure.
+int loader_load_columns(struct loader* l, const char* path, struct vector** columns, uint32_t column_count);
+
+/// Get the stats accumulated over every load so far.
+const struct load_stats* loader_stats(struct loader* l);
+
+/// Destroy this loader, freeing every string it loaded.
+void loader_destroy(struct loader* l);
@@ -1,8 +1,22 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "load/loader.h"
+#include "queue/mpmc.h"
 #include "vec/vector.h"
 
+#define SAMPLE_ROWS 2000000
+#define QUEUE_THREADS 16
+#define QUEUE_ITEMS 200000
+#define QUEUE_BATCH 32
+#define QUEUE_BATCHES 1024
+#define QUEUE_CAPACITY 1024
+#define QUEUE_PINGS 200000
+
 void* mapperfnmul2(void* elem, uint32_t index)
 {
     int* db = malloc(sizeof(int));
@@ -29,7 +43,292 @@ void foreachfn(void* elem, uint32_t index)
     printf("foreach: element %i: %i\n", index, *(int*)elem);
 }
 
-int main() {
+static void print_stage(const char* stage, uint64_t bytes, uint64_t ns)
+{
+    printf("  %-7s %8.2fms %8.1f MiB/s\n", stage, ns / 1e6, ns == 0 ? 0.0 : (bytes / (1024.0 * 1024.0)) / (ns / 1e9));
+}
+
+// load `path' (or a generated sample file) into a vector of records and report per-stage throughput.
+// `has_header' skips the first line of `path'; the generated sample always has one
+int load_demo(const char* path, int has_header)
+{
+    char sample[] = "/tmp/vec_ll_sampleXXXXXX";
+    if (path == NULL)
+    {
+        int fd = mkstemp(sample);
+        FILE* f = fd < 0 ? NULL : fdopen(fd, "w");
+        if (f == NULL)
+        {
+            perror("failed to create sample file");
+            return 1;
+        }
+        fprintf(f, "name,age\n");
+        for (int i = 0; i < SAMPLE_ROWS; i++)
+        {
+            fprintf(f, "person %d,%d\n", i % 5000, i % 100);
+        }
+        fclose(f);
+        path = sample;
+        has_header = 1;
+    }
+
+    struct load_options opts = { .has_header = has_header, .intern_names = 1 };
+    struct loader* l = loader_new(&opts);
+    struct vector* records = vec_new(sizeof(struct record));
+    if (l == NULL || records == NULL || loader_load_records(l, path, records) != 0)
+    {
+        perror("failed to load records");
+        return 1;
+    }
+
+    const struct load_stats* stats = loader_stats(l);
+    printf("loaded %u records from %s (%lu bytes, %lu windows, %u threads)\n", records->len, path, stats->bytes,
+        stats->windows, l->options.threads);
+    print_stage("map", stats->bytes, stats->map_ns);
+    print_stage("parse", stats->bytes, stats->parse_ns);
+    print_stage("append", stats->bytes, stats->append_ns);
+    print_stage("total", stats->bytes, stats->map_ns + stats->parse_ns + stats->append_ns);
+
+    if (records->len > 1)
+    {
+        struct record* a = vec_get(records, 0);
+        struct record* b = vec_get(records, 1);
+        printf("first record: %s, %d; interned names compare by pointer: %s\n", a->name, a->age,
+            (a->name == b->name) == (strcmp(a->name, b->name) == 0) ? "yes" : "no");
+    }
+
+    vec_destroy(records);
+    loader_destroy(l);
+    if (path == sample)
+    {
+        unlink(sample);
+    }
+    return 0;
+}
+
+struct queue_bench {
+    struct mpmc_queue* q;
+    // the mutex-guarded vector FIFO the queue replaces
+    struct vector* fifo;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    struct vector** batches;
+    uint32_t batch;
+    _Atomic uint64_t rows;
+};
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void* queue_producer(void* arg)
+{
+    struct queue_bench* b = arg;
+    void* values[QUEUE_BATCH];
+    for (uint32_t i = 0; i < QUEUE_ITEMS; i += b->batch)
+    {
+        for (uint32_t j = 0; j < b->batch; j++)
+        {
+            values[j] = b->batches[(i + j) % QUEUE_BATCHES];
+        }
+        if (b->q != NULL)
+        {
+            mpmc_push_many(b->q, values, b->batch);
+            continue;
+        }
+
+        pthread_mutex_lock(&b->lock);
+        while (b->fifo->len >= QUEUE_CAPACITY)
+        {
+            pthread_cond_wait(&b->not_full, &b->lock);
+        }
+        vec_push(b->fifo, &values[0]);
+        pthread_cond_signal(&b->not_empty);
+        pthread_mutex_unlock(&b->lock);
+    }
+    return NULL;
+}
+
+static void* queue_consumer(void* arg)
+{
+    struct queue_bench* b = arg;
+    void* values[QUEUE_BATCH];
+    uint64_t rows = 0;
+    uint32_t done = 0;
+    while (!done)
+    {
+        uint32_t n = 1;
+        if (b->q != NULL)
+        {
+            n = mpmc_pop_many(b->q, values, b->batch);
+        }
+        else
+        {
+            pthread_mutex_lock(&b->lock);
+            while (b->fifo->len == 0)
+            {
+                pthread_cond_wait(&b->not_empty, &b->lock);
+            }
+            void** front = vec_shift(b->fifo);
+            values[0] = *front;
+            free(front);
+            pthread_cond_signal(&b->not_full);
+            pthread_mutex_unlock(&b->lock);
+        }
+
+        // a NULL batch means stop. everything queued after it is NULL too, so hand back the extra ones we took
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (values[i] == NULL)
+            {
+                if (!done && b->q != NULL)
+                {
+                    mpmc_push_many(b->q, values + i + 1, n - i - 1);
+                }
+                done = 1;
+                break;
+            }
+            rows += ((struct vector*)values[i])->len;
+        }
+    }
+    atomic_fetch_add(&b->rows, rows);
+    return NULL;
+}
+
+// run QUEUE_THREADS producers against QUEUE_THREADS consumers, on the lock-free queue if `q' is set and the vector FIFO otherwise
+static int queue_run(const char* name, struct queue_bench* b, struct mpmc_queue* q, uint32_t batch)
+{
+    pthread_t producers[QUEUE_THREADS];
+    pthread_t consumers[QUEUE_THREADS];
+    b->q = q;
+    b->batch = batch;
+    atomic_store(&b->rows, 0);
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < QUEUE_THREADS; i++)
+    {
+        if (pthread_create(&consumers[i], NULL, queue_consumer, b) != 0 ||
+            pthread_create(&producers[i], NULL, queue_producer, b) != 0)
+        {
+            perror("failed to start queue threads");
+            return 1;
+        }
+    }
+    for (int i = 0; i < QUEUE_THREADS; i++)
+    {
+        pthread_join(producers[i], NULL);
+    }
+    for (int i = 0; i < QUEUE_THREADS; i++)
+    {
+        void* stop = NULL;
+        if (q != NULL)
+        {
+            mpmc_push(q, stop);
+            continue;
+        }
+        pthread_mutex_lock(&b->lock);
+        vec_push(b->fifo, &stop);
+        pthread_cond_signal(&b->not_empty);
+        pthread_mutex_unlock(&b->lock);
+    }
+    for (int i = 0; i < QUEUE_THREADS; i++)
+    {
+        pthread_join(consumers[i], NULL);
+    }
+    uint64_t ns = now_ns() - start;
+
+    uint64_t items = (uint64_t)QUEUE_THREADS * QUEUE_ITEMS / (q != NULL ? 1 : batch);
+    printf("  %-14s %8.2fms %8.2f M batches/s, %lu rows\n", name, ns / 1e6, items / (ns / 1e3), atomic_load(&b->rows));
+    return 0;
+}
+
+static void* queue_echo(void* arg)
+{
+    struct mpmc_queue** pair = arg;
+    for (int i = 0; i < QUEUE_PINGS; i++)
+    {
+        mpmc_push(pair[1], mpmc_pop(pair[0]));
+    }
+    return NULL;
+}
+
+// hand batches between producer and consumer threads through the lock-free queue and the mutex-guarded vector it replaces
+int queue_demo()
+{
+    struct queue_bench b = { .lock = PTHREAD_MUTEX_INITIALIZER, .not_empty = PTHREAD_COND_INITIALIZER,
+        .not_full = PTHREAD_COND_INITIALIZER };
+    b.batches = malloc(QUEUE_BATCHES * sizeof(struct vector*));
+    b.fifo = vec_new(sizeof(void*));
+    struct mpmc_queue* q = mpmc_new(QUEUE_CAPACITY);
+    if (b.batches == NULL || b.fifo == NULL || q == NULL)
+    {
+        perror("failed to create queues");
+        return 1;
+    }
+    for (int i = 0; i < QUEUE_BATCHES; i++)
+    {
+        b.batches[i] = vec_new_with_capacity(sizeof(int), 4);
+        if (b.batches[i] == NULL)
+        {
+            return 1;
+        }
+        vec_push(b.batches[i], &i);
+    }
+
+    printf("%d producers, %d consumers, %d batches each:\n", QUEUE_THREADS, QUEUE_THREADS, QUEUE_ITEMS);
+    if (queue_run("mutex+vector", &b, NULL, QUEUE_BATCH) != 0 ||
+        queue_run("mpmc", &b, q, 1) != 0 ||
+        queue_run("mpmc batched", &b, q, QUEUE_BATCH) != 0)
+    {
+        return 1;
+    }
+
+    // ping-pong a batch between two threads; each round trip is two handoffs
+    struct mpmc_queue* pair[2] = { mpmc_new(2), mpmc_new(2) };
+    pthread_t echo;
+    if (pair[0] == NULL || pair[1] == NULL || pthread_create(&echo, NULL, queue_echo, pair) != 0)
+    {
+        perror("failed to start echo thread");
+        return 1;
+    }
+    uint64_t start = now_ns();
+    for (int i = 0; i < QUEUE_PINGS; i++)
+    {
+        mpmc_push(pair[0], b.batches[0]);
+        mpmc_pop(pair[1]);
+    }
+    uint64_t ns = now_ns() - start;
+    pthread_join(echo, NULL);
+    printf("  handoff latency: %.0fns\n", ns / (2.0 * QUEUE_PINGS));
+
+    for (int i = 0; i < QUEUE_BATCHES; i++)
+    {
+        vec_destroy(b.batches[i]);
+    }
+    free(b.batches);
+    vec_destroy(b.fifo);
+    mpmc_destroy(q);
+    mpmc_destroy(pair[0]);
+    mpmc_destroy(pair[1]);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "load") == 0)
+    {
+        // vec_ll load [--header] [file]
+        int has_header = argc > 2 && strcmp(argv[2], "--header") == 0;
+        return load_demo(argc > 2 + has_header ? argv[2 + has_header] : NULL, has_header);
+    }
+    if (argc > 1 && strcmp(argv[1], "queue") == 0)
+    {
+        return queue_demo();
+    }
+
     struct vector* v = vec_new(sizeof(int));
     if (v == NULL)
     {
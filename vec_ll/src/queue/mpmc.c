@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "mpmc.h"
+
+static void _mpmc_futex_wait(_Atomic uint32_t* addr, uint32_t expected)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void _mpmc_futex_wake(_Atomic uint32_t* addr, uint32_t count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count > INT32_MAX ? INT32_MAX : (int)count, NULL, NULL, 0);
+}
+
+static void _mpmc_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ volatile("yield" ::: "memory");
+#endif
+}
+
+// wake up to `count' sleepers after values were pushed or popped.
+// the fence pairs with the one in `_mpmc_wait': either the sleeper sees our change when it rechecks, or we see it waiting
+static void _mpmc_wake(_Atomic uint32_t* seq, _Atomic uint32_t* waiting, uint32_t count)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(waiting, memory_order_relaxed) > 0)
+	{
+		atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);
+		_mpmc_futex_wake(seq, count);
+	}
+}
+
+struct mpmc_queue* mpmc_new(uint32_t capacity)
+{
+	size_t size = 2;
+	while (size < capacity)
+	{
+		size *= 2;
+	}
+
+	struct mpmc_queue* q = aligned_alloc(alignof(struct mpmc_queue), sizeof(struct mpmc_queue));
+	if (q == NULL)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(q, 0, sizeof(struct mpmc_queue));
+
+	q->slots = malloc(size * sizeof(struct mpmc_slot));
+	if (q->slots == NULL)
+	{
+		errno = ENOMEM;
+		free(q);
+		return NULL;
+	}
+
+	// slot i is free for the push at position i
+	for (size_t i = 0; i < size; i++)
+	{
+		atomic_init(&q->slots[i].seq, i);
+		q->slots[i].value = NULL;
+	}
+	q->mask = size - 1;
+	return q;
+}
+
+// claim up to `count' consecutive slots starting at the current position of `pos_index'.
+// a slot is ready when its sequence number is `pos + offset' (which differs between pushes and pops).
+// returns the first claimed position in `*first' and the amount claimed
+static uint32_t _mpmc_claim(struct mpmc_queue* q, _Atomic size_t* pos_index, size_t offset, uint32_t count, size_t* first)
+{
+	size_t pos = atomic_load_explicit(pos_index, memory_order_relaxed);
+	for (;;)
+	{
+		// count how many slots in a row are ready for us. nobody else can make a ready slot unready without first
+		// moving `pos_index' past it, which makes our compare-and-swap below fail
+		uint32_t n = 0;
+		intptr_t diff = 0;
+		while (n < count)
+		{
+			size_t seq = atomic_load_explicit(&q->slots[(pos + n) & q->mask].seq, memory_order_acquire);
+			diff = (intptr_t)seq - (intptr_t)(pos + n + offset);
+			if (diff != 0)
+			{
+				break;
+			}
+			n++;
+		}
+
+		if (n == 0)
+		{
+			if (diff < 0)
+			{
+				// the slot at `pos' has not been released by the other side yet: full (pushing) or empty (popping)
+				return 0;
+			}
+			// someone else already took `pos': retry from the new position
+			pos = atomic_load_explicit(pos_index, memory_order_relaxed);
+			continue;
+		}
+
+		if (atomic_compare_exchange_weak_explicit(pos_index, &pos, pos + n, memory_order_relaxed, memory_order_relaxed))
+		{
+			*first = pos;
+			return n;
+		}
+	}
+}
+
+uint32_t mpmc_try_push_many(struct mpmc_queue* q, void** values, uint32_t count)
+{
+	if (q == NULL)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	size_t pos;
+	uint32_t n = _mpmc_claim(q, &q->enqueue_pos, 0, count, &pos);
+	for (uint32_t i = 0; i < n; i++)
+	{
+		struct mpmc_slot* slot = &q->slots[(pos + i) & q->mask];
+		slot->value = values[i];
+		// publish: consumers wait for pos + 1
+		atomic_store_explicit(&slot->seq, pos + i + 1, memory_order_release);
+	}
+
+	if (n > 0)
+	{
+		_mpmc_wake(&q->not_empty_seq, &q->consumers_waiting, n);
+	}
+	return n;
+}
+
+uint32_t mpmc_try_pop_many(struct mpmc_queue* q, void** out, uint32_t count)
+{
+	if (q == NULL)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	size_t pos;
+	uint32_t n = _mpmc_claim(q, &q->dequeue_pos, 1, count, &pos);
+	for (uint32_t i = 0; i < n; i++)
+	{
+		struct mpmc_slot* slot = &q->slots[(pos + i) & q->mask];
+		out[i] = slot->value;
+		// release the slot for the push one lap later
+		atomic_store_explicit(&slot->seq, pos + i + q->mask + 1, memory_order_release);
+	}
+
+	if (n > 0)
+	{
+		_mpmc_wake(&q->not_full_seq, &q->producers_waiting, n);
+	}
+	return n;
+}
+
+int mpmc_try_push(struct mpmc_queue* q, void* value)
+{
+	return mpmc_try_push_many(q, &value, 1) == 1 ? 0 : -1;
+}
+
+int mpmc_try_pop(struct mpmc_queue* q, void** out)
+{
+	return mpmc_try_pop_many(q, out, 1) == 1 ? 0 : -1;
+}
+
+// sleep until `seq' moves on, unless `attempt' succeeds after announcing ourselves in `waiting'
+static uint32_t _mpmc_wait(struct mpmc_queue* q, _Atomic uint32_t* seq, _Atomic uint32_t* waiting,
+	uint32_t (*attempt)(struct mpmc_queue*, void**, uint32_t), void** values, uint32_t count)
+{
+	for (;;)
+	{
+		for (int i = 0; i < _MPMC_SPIN_ROUNDS; i++)
+		{
+			uint32_t n = attempt(q, values, count);
+			if (n > 0)
+			{
+				return n;
+			}
+			_mpmc_relax();
+		}
+
+		uint32_t s = atomic_load_explicit(seq, memory_order_relaxed);
+		atomic_fetch_add_explicit(waiting, 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+
+		uint32_t n = attempt(q, values, count);
+		if (n == 0)
+		{
+			_mpmc_futex_wait(seq, s);
+		}
+		atomic_fetch_sub_explicit(waiting, 1, memory_order_relaxed);
+
+		if (n > 0)
+		{
+			return n;
+		}
+	}
+}
+
+void mpmc_push_many(struct mpmc_queue* q, void** values, uint32_t count)
+{
+	if (q == NULL)
+	{
+		errno = EINVAL;
+		return;
+	}
+
+	while (count > 0)
+	{
+		uint32_t n = _mpmc_wait(q, &q->not_full_seq, &q->producers_waiting, mpmc_try_push_many, values, count);
+		values += n;
+		count -= n;
+	}
+}
+
+uint32_t mpmc_pop_many(struct mpmc_queue* q, void** out, uint32_t count)
+{
+	if (q == NULL || count == 0)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	return _mpmc_wait(q, &q->not_empty_seq, &q->consumers_waiting, mpmc_try_pop_many, out, count);
+}
+
+void mpmc_push(struct mpmc_queue* q, void* value)
+{
+	mpmc_push_many(q, &value, 1);
+}
+
+void* mpmc_pop(struct mpmc_queue* q)
+{
+	void* value = NULL;
+	mpmc_pop_many(q, &value, 1);
+	return value;
+}
+
+uint32_t mpmc_len(struct mpmc_queue* q)
+{
+	if (q == NULL)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	size_t head = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+	return tail > head ? (uint32_t)(tail - head) : 0;
+}
+
+void mpmc_destroy(struct mpmc_queue* q)
+{
+	if (q == NULL)
+	{
+		errno = EINVAL;
+		return;
+	}
+	free(q->slots);
+	free(q);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/// Assumed size of a cache line. The queue's hot indices each get a line to themselves so producers and consumers do not false-share.
+#define _MPMC_CACHE_LINE 64
+/// Number of failed attempts a blocking push or pop spins through before sleeping on the futex.
+#define _MPMC_SPIN_ROUNDS 128
+
+struct mpmc_slot {
+	/// Tells producers and consumers whose turn this slot is: `pos' when free for the push at position `pos',
+	/// `pos + 1' once that push has filled it.
+	_Atomic size_t seq;
+	void* value;
+};
+
+/// A bounded lock-free multi-producer multi-consumer FIFO of pointers, e.g. `struct vector*' batches handed between threads.
+/// Follows Dmitry Vyukov's bounded MPMC queue: every slot carries a sequence number, so a push or pop only contends
+/// on a single compare-and-swap of its index. The blocking functions spin briefly and then sleep on a futex until the
+/// queue stops being full or empty.
+struct mpmc_queue {
+	alignas(_MPMC_CACHE_LINE) _Atomic size_t enqueue_pos;
+	alignas(_MPMC_CACHE_LINE) _Atomic size_t dequeue_pos;
+	alignas(_MPMC_CACHE_LINE) struct mpmc_slot* slots;
+	size_t mask;
+	/// Bumped and futex-woken when values are pushed while consumers sleep.
+	alignas(_MPMC_CACHE_LINE) _Atomic uint32_t not_empty_seq;
+	_Atomic uint32_t consumers_waiting;
+	/// Bumped and futex-woken when values are popped while producers sleep.
+	alignas(_MPMC_CACHE_LINE) _Atomic uint32_t not_full_seq;
+	_Atomic uint32_t producers_waiting;
+};
+
+/// Create a queue holding at least `capacity' values (rounded up to a power of two). If the queue cannot be created, NULL is returned.
+/// To free this queue, call mpmc_destroy.
+struct mpmc_queue* mpmc_new(uint32_t capacity);
+
+/// Push a value without blocking. Returns 0, or -1 if the queue is full.
+int mpmc_try_push(struct mpmc_queue* q, void* value);
+/// Pop the oldest value into `out' without blocking. Returns 0, or -1 if the queue is empty.
+int mpmc_try_pop(struct mpmc_queue* q, void** out);
+
+/// Push as many of the `count' values as currently fit, in order, claiming their slots all at once. Returns the amount pushed.
+uint32_t mpmc_try_push_many(struct mpmc_queue* q, void** values, uint32_t count);
+/// Pop up to `count' of the oldest values into `out', claiming their slots all at once. Returns the amount popped.
+uint32_t mpmc_try_pop_many(struct mpmc_queue* q, void** out, uint32_t count);
+
+/// Push a value, waiting while the queue is full.
+void mpmc_push(struct mpmc_queue* q, void* value);
+/// Pop the oldest value, waiting while the queue is empty.
+void* mpmc_pop(struct mpmc_queue* q);
+
+/// Push all `count' values, waiting whenever the queue is full. Values from other producers may be interleaved between batches.
+void mpmc_push_many(struct mpmc_queue* q, void** values, uint32_t count);
+/// Pop between 1 and `count' values into `out', waiting while the queue is empty. Returns the amount popped.
+uint32_t mpmc_pop_many(struct mpmc_queue* q, void** out, uint32_t count);
+
+/// Get the approximate amount of values in the queue. Only exact while no other thread is using it.
+uint32_t mpmc_len(struct mpmc_queue* q);
+
+/// Destroy this queue. Values still in it are not freed.
+void mpmc_destroy(struct mpmc_queue* q);
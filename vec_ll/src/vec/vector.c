@@ -144,6 +144,25 @@ void vec_push(struct vector* v, void* data)
 	v->len++;
 }
 
+void vec_extend(struct vector* v, void* data, uint32_t count)
+{
+	if (v == NULL)
+	{
+		errno = EINVAL;
+		return;
+	}
+
+	// grow once up front rather than doubling repeatedly while pushing
+	vec_reserve(v, v->len + count);
+	if (v->capacity < v->len + count)
+	{
+		return;
+	}
+
+	memcpy(v->data + v->len * v->elem_size, data, (size_t)count * v->elem_size);
+	v->len += count;
+}
+
 void vec_insert(struct vector* v, void* data, uint32_t index)
 {
 	if (v == NULL)
@@ -319,6 +338,37 @@ void vec_grow(struct vector* v)
 	v->data = new;
 }
 
+void vec_reserve(struct vector* v, uint32_t capacity)
+{
+	if (v == NULL)
+	{
+		errno = EINVAL;
+		return;
+	}
+
+	if (capacity <= v->capacity)
+	{
+		return;
+	}
+
+	// keep growing geometrically so repeated small reserves stay amortised
+	uint32_t new_capacity = v->capacity * _VEC_CAPACITY_MULTIPLIER;
+	if (new_capacity < capacity)
+	{
+		new_capacity = capacity;
+	}
+
+	char* new = realloc(v->data, (size_t)new_capacity * v->elem_size);
+	if (new == NULL)
+	{
+		errno = ENOMEM;
+		return;
+	}
+
+	v->capacity = new_capacity;
+	v->data = new;
+}
+
 uint32_t vec_len(struct vector* v)
 {
 	if (v == NULL)
@@ -43,6 +43,8 @@ void* vec_set(struct vector* v, void* data, uint32_t index);
 
 /// Push a new element to the end of the vector. The element is copied. The element must have a width of elem_size.
 void vec_push(struct vector* v, void* data);
+/// Push `count' elements stored contiguously at `data' to the end of the vector, growing it at most once. The elements are copied.
+void vec_extend(struct vector* v, void* data, uint32_t count);
 /// Insert an element at an arbitrary position in the vector.
 void vec_insert(struct vector* v, void* data, uint32_t index);
 /// Insert an element at the start of the vector.
@@ -66,6 +68,9 @@ void vec_reverse_inplace(struct vector *v);
 /// Increase the capacity of this vector based on the _VEC_CAPACITY_MULTIPLIER value.
 void vec_grow(struct vector* v);
 
+/// Make sure this vector can hold at least `capacity' elements without growing again.
+void vec_reserve(struct vector* v, uint32_t capacity);
+
 /// Get the amount of elements currently stored in this vector.
 uint32_t vec_len(struct vector* v);
 